@@ -27,7 +27,7 @@
 
 Application::Application()
 {
-    m_chip8 = new Chip8();
+    m_emulator = new Emulator();
     m_frontend = new FrontEnd(this);
 
     // Create a window sized by the CHIP8 resolution
@@ -40,7 +40,7 @@ Application::Application()
 
 Application::~Application()
 {
-    delete m_chip8;
+    delete m_emulator;
 }
 
 
@@ -48,20 +48,22 @@ Application::~Application()
 void
 Application::LoadFile(const char *filename)
 {
-    m_latestFile = std::string(filename);
-    m_chip8->LoadGame(filename);
-    m_disassembled = m_chip8->GetDisassembled();
-
-    // Reset PixelColor
-    for (auto & p : PixelColor) p = m_themes[m_isLightTheme].bg;
+    // Loaded at the start of the next emulated frame; Update() picks up the program and the new display
+    m_emulator->LoadFile(filename);
 }
 
 void
 Application::Setup()
 {
+    // Texture the display is uploaded to
+    SetFilter(Upscaler::filter_t::None);
+
     LoadFile("roms/TEST.ch8");
+    SetSpeed(m_emulation_cfg.speed);
 
     m_frontend->Setup();
+
+    m_emulator->Start();
 }
 
 void
@@ -69,10 +71,13 @@ Application::Input()
 {
     for (const auto& [key, value] : m_keyMapping)
     {
-        if (IsKeyDown(key)) m_chip8->SetKey(value, true);
-        else if (IsKeyReleased(key)) m_chip8->SetKey(value, false);
+        if (IsKeyPressed(key)) m_emulator->SetKey(value, true);
+        else if (IsKeyReleased(key)) m_emulator->SetKey(value, false);
     }
 
+    // Fast-forward
+    if (IsKeyPressed(KEY_TAB)) SetTurbo(!m_isTurbo);
+
     if (IsKeyPressed(KEY_F1))
     {
         // Toggle the debug UI
@@ -86,91 +91,69 @@ Application::Input()
 void
 Application::Update()
 {
-    if (!m_isPaused)
+    // The emulation runs on its own; take the newest frame it finished, if any
+    if (!m_emulator->Update()) return;
+
+    const Emulator::frame_t &frame = m_emulator->GetFrame();
+    if (frame.loads != m_loads)
     {
-        for (int i = 0; i < m_speeds[m_emulation_cfg.speed]; ++i)
-        {
-            m_chip8->Clock();
-        }
+        m_loads = frame.loads;
+        m_disassembled = m_emulator->GetDisassembled();
+
+        // Reset the pixel colors
+        m_framebuffer.Reset(ToRgba(m_themes[m_isLightTheme].bg));
     }
+
+    if (m_deflicker.GetMode() != Deflicker::mode_t::Off) m_deflicker.Push(frame.machine);
 }
 
 void
 Application::Reset()
 {
-    m_chip8->Reset();
-    m_chip8->LoadGame(m_latestFile.c_str());
-    m_disassembled = m_chip8->GetDisassembled();
-
-    // Reset PixelColor
-    for (auto & p : PixelColor) p = m_themes[m_isLightTheme].bg;
+    m_emulator->Reset();
 }
 
 void Application::Render()
 {
-    if (!m_chip8->GetDrawFlag()) return;
+    const ColorPalette &theme = m_themes[m_isLightTheme];
+
+    // Fade the pixels towards the display, and scale and upload them only when they changed
+    float halfLife = -m_emulation_cfg.lerp_duration / log2f(m_emulation_cfg.precision);
+    const Framebuffer::palette_t palette = {ToRgba(theme.bg), ToRgba(theme.fg), ToRgba(theme.fg2), ToRgba(theme.blend)};
+
+    bool isChanged;
+    if (m_deflicker.GetMode() != Deflicker::mode_t::Off)
+    {
+        isChanged = m_framebuffer.Compose(m_deflicker, palette, halfLife, GetFrameTime());
+    }
+    else
+    {
+        isChanged = m_framebuffer.Compose(m_emulator->GetFrame().machine, palette, halfLife, GetFrameTime());
+    }
+
+    // The other resolution takes another scale, texture and grid
+    if (m_framebuffer.GetWidth() != m_upscaler.GetSourceWidth()) SetFilter(m_upscaler.GetFilter());
+
+    if (isChanged || m_isScreenStale)
+    {
+        m_upscaler.Run(m_framebuffer.GetPixels());
+        UpdateTexture(m_screen, m_upscaler.GetPixels());
+        m_isScreenStale = false;
+    }
+
+    // The lines follow the theme
+    if (m_showLines && m_gridTheme != m_isLightTheme) BakeGrid();
 
     BeginDrawing();
 
-        ClearBackground(m_themes[m_isLightTheme].bg);
+        ClearBackground(theme.bg);
 
-        // CHIP-8 display
-        {
-            auto display = m_chip8->GetDisplay();
-
-            for (int y = 0; y < 32; ++y)
-            {
-                for (int x = 0; x < 64; ++x)
-                {
-                    // Get the current color of the pixel
-                    int32_t i = y * 64 + x;
-                    Color currentColor = PixelColor[i];
-
-                    // Determine the target color based on the display data
-                    bool isPixelOn = display[i];
-                    Color targetColor = isPixelOn
-                                        ? m_themes[m_isLightTheme].fg
-                                        : m_themes[m_isLightTheme].bg;
-
-                    // Check if the current color is different from the target color
-                    bool isColorDifferent = currentColor.r != targetColor.r
-                                            || currentColor.g != targetColor.g
-                                            || currentColor.b != targetColor.b
-                                            || currentColor.a != targetColor.a;
-
-                    // Only calculate the new color if the current color is different from the target color
-                    if (isColorDifferent)
-                    {
-                        // Define the lerp factor (-t/log2(precision))
-                        float lerpFactor = -m_emulation_cfg.lerp_duration / log2f(m_emulation_cfg.precision);
-
-                        // Calculate the new color
-                        PixelColor[i] = ColorLerp(currentColor, targetColor, lerpFactor);
-                    }
-
-                    // Draw the rectangle with the new color
-                    DrawRectangle(x * 10, y * 10 + 20, 10, 10, PixelColor[i]);
-                }
-            }
-        }
+        // CHIP-8 display, stretched over whatever scale the filter left as one quad
+        DrawTexturePro(m_screen, {0, 0, (float)m_upscaler.GetWidth(), (float)m_upscaler.GetHeight()},
+                       {0, 20, (float)m_displayWidth, (float)m_displayHeight - 20}, {0, 0}, 0.0F, WHITE);
 
         // Lines
-        if (m_showLines)
-        {
-            Color backgroundColor = Fade(m_themes[m_isLightTheme].bg, 0.25f);
-            Color foregroundColor = Fade(m_themes[m_isLightTheme].fg, 0.25f);
-
-            for (uint16_t i = 0; i < 64; ++i)
-            {
-                if (i < 32)
-                {
-                    DrawLine(0, i * 10 + 20, 64 * 10, i * 10 + 20, backgroundColor);
-                    DrawLine(0, i * 10 + 20, 64 * 10, i * 10 + 20, foregroundColor);
-                }
-                DrawLine(i * 10, 0 + 20, i * 10, 32 * 10 + 20, backgroundColor);
-                DrawLine(i * 10, 0 + 20, i * 10, 32 * 10 + 20, foregroundColor);
-            }
-        }
+        if (m_showLines) DrawTexture(m_grid, 0, 20, WHITE);
 
         // Draw the frontend
         m_frontend->Draw();
@@ -178,9 +161,61 @@ void Application::Render()
     EndDrawing();
 }
 
+void
+Application::SetFilter(Upscaler::filter_t filter)
+{
+    const uint32_t width = m_framebuffer.GetWidth(), height = m_framebuffer.GetHeight();
+    m_upscaler.Configure(filter, width, height, m_displayWidth / width);
+
+    // A texture the size of the new output, filled on the next frame
+    if (m_screen.id != 0) UnloadTexture(m_screen);
+    Image image = GenImageColor((int)m_upscaler.GetWidth(), (int)m_upscaler.GetHeight(), m_themes[m_isLightTheme].bg);
+    m_screen = LoadTextureFromImage(image);
+    UnloadImage(image);
+
+    m_isScreenStale = true;
+    m_gridTheme = -1;
+}
+
+void
+Application::BakeGrid()
+{
+    // The faded background and foreground lines over each other, as one color
+    const ColorPalette &theme = m_themes[m_isLightTheme];
+    const float alpha = 0.25F + 0.25F * 0.75F;
+    auto blend = [&](uint8_t bg, uint8_t fg) { return (uint8_t)((fg * 0.25F + bg * 0.25F * 0.75F) / alpha); };
+    const Color line = {blend(theme.bg.r, theme.fg.r), blend(theme.bg.g, theme.fg.g),
+                        blend(theme.bg.b, theme.fg.b), (uint8_t)(alpha * 255)};
+
+    // One cell per CHIP-8 pixel
+    const int width = m_displayWidth, height = m_displayHeight - 20;
+    const int cell = width / (int)m_framebuffer.GetWidth();
+    Image image = GenImageColor(width, height, BLANK);
+
+    Color* pixels = (Color*)image.data;
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            if (x % cell == 0 || y % cell == 0) pixels[y * width + x] = line;
+        }
+    }
+
+    if (m_grid.id != 0) UnloadTexture(m_grid);
+    m_grid = LoadTextureFromImage(image);
+    UnloadImage(image);
+
+    m_gridTheme = m_isLightTheme;
+}
+
 void
 Application::Destroy()
 {
     m_isRunning = false;
+    m_emulator->Stop();
+
+    UnloadTexture(m_screen);
+    if (m_grid.id != 0) UnloadTexture(m_grid);
+
     CloseWindow();
 }
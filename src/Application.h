@@ -28,7 +28,10 @@
 
 #include "raylib.h"
 
-#include "chip8/Chip8.h"
+#include "Emulator.h"
+#include "render/Deflicker.h"
+#include "render/Framebuffer.h"
+#include "render/Upscaler.h"
 
 // Forward declaration
 class FrontEnd;
@@ -36,11 +39,13 @@ class FrontEnd;
 class Application
 {
 public:
-    // Color palette
+    // Color palette; XO-CHIP lights pixels in a second plane, or both
     typedef struct ColorPalette
     {
         Color bg;
         Color fg;
+        Color fg2;
+        Color blend;
     } ColorPalette;
 
     typedef struct emulation_cfg_t
@@ -49,6 +54,7 @@ public:
         float lerp_duration;
 
         int32_t speed;
+        uint32_t run_ahead;
     } emulation_cfg_t;
 
 public:
@@ -69,29 +75,39 @@ public:
 
     void SetPaused(bool bPaused);
     void SetSpeed(int speed);
+    void SetTurbo(bool bTurbo);
+    void SetRunAhead(uint32_t frames);
     void SetKey(uint8_t key, bool bPressed);
 
     void SetDisplayLines(bool bShow);
     void SetLightTheme(bool bLight);
+    void SetFilter(Upscaler::filter_t filter);
+    void SetDeflicker(Deflicker::mode_t mode, uint32_t frames);
 
 private:
-    static Color ColorLerp(Color a, Color b, float halfLife);
+    // Bake the lines between cells into a texture, for the current theme
+    void BakeGrid();
+
+    static Framebuffer::rgba_t ToRgba(Color color);
 
 private:
     friend class FrontEnd;
 
     emulation_cfg_t m_emulation_cfg {0.01f, 0.7f};
 
-    Chip8    *m_chip8 {nullptr};
+    Emulator *m_emulator {nullptr};
     FrontEnd *m_frontend {nullptr};
 
     // TODO: move to a struct
     uint8_t m_isRunning     : 1  {false};
     uint8_t m_isPaused      : 1  {false};
+    uint8_t m_isTurbo       : 1  {false};
     uint8_t m_showLines     : 1  {false};
     uint8_t m_isLightTheme  : 1  {true};
 
+    // Program of the ROM, and the load of the emulator it is from
     std::map<uint16_t, std::string> m_disassembled;
+    uint32_t m_loads {0};
 
     // Window sizes (normal and ui)
     static constexpr uint32_t m_displayWidth    { 64 * 10 };               // 640
@@ -100,8 +116,16 @@ private:
     static constexpr uint32_t m_uiDisplacement  { 420 };
     static constexpr uint32_t m_windowWidthUI   { m_displayWidth + m_uiDisplacement };    // 940 (+ 300 for the ui)
 
-    // Display pixel colors
-    Color PixelColor[DISPLAY_SIZE] = {m_themes[m_isLightTheme].bg};
+    // Display pixel colors, from the display or its deflickered blend, scaled up to the texture they are uploaded to
+    Deflicker   m_deflicker;
+    Framebuffer m_framebuffer;
+    Upscaler    m_upscaler;
+    Texture2D   m_screen {0};
+    bool        m_isScreenStale {true};
+
+    // Lines between cells, and the theme they were baked for
+    Texture2D   m_grid {0};
+    int8_t      m_gridTheme {-1};
 
     // Execution speed map (cycles per frame)
     std::vector<uint32_t> m_speeds = {1, 2, 7, 10, 15, 20, 30, 60, 120, 240, 1000};
@@ -129,12 +153,9 @@ private:
 
     // Themes
     ColorPalette m_themes[2] = {
-            {DARKGRAY, WHITE},
-            {RAYWHITE, BLACK}
+            {DARKGRAY, WHITE, SKYBLUE, GOLD},
+            {RAYWHITE, BLACK, BLUE, MAROON}
     };
-
-    // Latest file loaded
-    std::string m_latestFile;
 };
 
 
@@ -147,19 +168,37 @@ Application::IsRunning() const
 inline void
 Application::SetPaused(bool bPaused)
 {
+    if (m_isPaused == bPaused) return;
+
     m_isPaused = bPaused;
+    m_emulator->SetPaused(bPaused);
 }
 
 inline void
 Application::SetSpeed(int speed)
 {
     m_emulation_cfg.speed = speed;
+    m_emulator->SetSpeed(m_speeds[speed]);
+}
+
+inline void
+Application::SetTurbo(bool bTurbo)
+{
+    m_isTurbo = bTurbo;
+    m_emulator->SetTurbo(bTurbo);
+}
+
+inline void
+Application::SetRunAhead(uint32_t frames)
+{
+    m_emulation_cfg.run_ahead = frames;
+    m_emulator->SetRunAhead(frames);
 }
 
 inline void
 Application::SetKey(uint8_t key, bool bPressed)
 {
-    m_chip8->SetKey(key, bPressed);
+    m_emulator->SetKey(key, bPressed);
 }
 
 inline void
@@ -172,24 +211,25 @@ inline void
 Application::SetLightTheme(bool bLight)
 {
     m_isLightTheme = bLight;
+
+    // Every pixel fades to the new palette
+    m_framebuffer.Refade();
+}
+
+inline void
+Application::SetDeflicker(Deflicker::mode_t mode, uint32_t frames)
+{
+    m_deflicker.Configure(mode, frames);
+    m_deflicker.Push(m_emulator->GetFrame().machine);
+
+    // Every pixel fades to the blend, or back to the display
+    m_framebuffer.Refade();
 }
 
-inline Color
-Application::ColorLerp(Color a, Color b, float halfLife)
+inline Framebuffer::rgba_t
+Application::ToRgba(Color color)
 {
-    // Get the time elapsed since the last frame
-    float deltaTime = GetFrameTime();
-
-    // Calculate the lerp factor based on the delta time and half-life
-    float t = 1.0F - exp2f(-deltaTime / halfLife);
-
-    return (Color)
-            {
-                    (uint8_t) (a.r + (b.r - a.r) * t),
-                    (uint8_t) (a.g + (b.g - a.g) * t),
-                    (uint8_t) (a.b + (b.b - a.b) * t),
-                    (uint8_t) (a.a + (b.a - a.a) * t)
-            };
+    return {color.r, color.g, color.b, color.a};
 }
 
 #endif //CHIP0U_APPLICATION_H
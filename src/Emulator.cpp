@@ -0,0 +1,341 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Emulator.h"
+
+#include <algorithm>
+#include <chrono>
+
+
+Emulator::Emulator()
+{
+    m_chip8 = std::make_unique<Chip8>();
+    m_snapshot = std::make_unique<Chip8::snapshot_t>();
+
+    // The UI starts from the machine as it is, before any frame
+    Publish();
+    m_frames.Update();
+}
+
+Emulator::~Emulator()
+{
+    Stop();
+}
+
+void
+Emulator::Start()
+{
+#if !__EMSCRIPTEN__
+    if (m_thread.joinable()) return;
+
+    m_isRunning = true;
+    m_thread = std::thread(&Emulator::Loop, this);
+#endif
+}
+
+void
+Emulator::Stop()
+{
+    m_isRunning = false;
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void
+Emulator::LoadFile(const std::string &filename)
+{
+    Send({action_t::LoadFile, 0, filename});
+}
+
+void
+Emulator::Reset()
+{
+    Send({action_t::Reset, 0, {}});
+}
+
+void
+Emulator::Step()
+{
+    Send({action_t::Step, 0, {}});
+}
+
+void
+Emulator::SetPaused(bool isPaused)
+{
+    Send({action_t::SetPaused, isPaused, {}});
+}
+
+void
+Emulator::SetSpeed(uint32_t cycles)
+{
+    Send({action_t::SetSpeed, cycles, {}});
+}
+
+void
+Emulator::SetTurbo(bool isTurbo)
+{
+    Send({action_t::SetTurbo, isTurbo, {}});
+}
+
+void
+Emulator::SetRunAhead(uint32_t frames)
+{
+    Send({action_t::SetRunAhead, frames, {}});
+}
+
+void
+Emulator::SetKey(uint8_t key, bool isDown)
+{
+    Send({action_t::SetKey, (uint32_t)key << 1 | isDown, {}, std::chrono::steady_clock::now()});
+}
+
+void
+Emulator::SetBackend(Chip8::backend_t backend)
+{
+    Send({action_t::SetBackend, (uint32_t)backend, {}});
+}
+
+void
+Emulator::SetProfile(Chip8::profile_t profile)
+{
+    Send({action_t::SetProfile, (uint32_t)profile, {}});
+}
+
+bool
+Emulator::Update()
+{
+    // Without a thread, the frames are run here, at the UI's pace
+    if (!m_thread.joinable()) Tick();
+
+    return m_frames.Update();
+}
+
+std::map<uint16_t, std::string>
+Emulator::GetDisassembled() const
+{
+    std::lock_guard<std::mutex> lock(m_disassembledMutex);
+    return m_disassembled;
+}
+
+void
+Emulator::Send(const command_t &command)
+{
+    // Full only when the emulation is far behind; wait for it rather than lose a key
+    while (!m_commands.Push(command))
+    {
+        if (m_thread.joinable()) std::this_thread::yield();
+        else RunCommands();
+    }
+}
+
+void
+Emulator::Loop()
+{
+    using clock = std::chrono::steady_clock;
+    const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / EMULATOR_FRAME_RATE));
+
+    auto next = clock::now();
+    while (m_isRunning)
+    {
+        Tick();
+
+        // Frames missed, as after the machine slept, are dropped rather than run back to back
+        next += period;
+        const auto now = clock::now();
+        if (now > next) next = now;
+        else std::this_thread::sleep_until(next);
+    }
+}
+
+void
+Emulator::Tick()
+{
+    RunCommands();
+
+    m_instructions = 0;
+    if (!m_isPaused) m_speedFrames += RunFrames();
+
+    // Turbo is ahead already
+    if (m_runAhead != 0 && !m_isPaused && !m_isTurbo) RunAhead();
+    else Publish();
+
+    // Guest time over wall time, paused frames included
+    const auto now = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> elapsed = now - m_speedStart;
+    if (elapsed.count() >= EMULATOR_SPEED_WINDOW)
+    {
+        m_speed = (float)(m_speedFrames / (double)EMULATOR_FRAME_RATE / elapsed.count());
+        m_speedStart = now;
+        m_speedFrames = 0;
+    }
+}
+
+uint32_t
+Emulator::RunFrames()
+{
+    if (!m_isTurbo)
+    {
+        m_instructions += m_chip8->RunFor(1.0 / EMULATOR_FRAME_RATE).cycles;
+        return 1;
+    }
+
+    // Whatever fits in the frame, however short or long the guest's frames are; the ones before
+    // the last are never shown
+    using clock = std::chrono::steady_clock;
+    const auto budget = std::chrono::duration<double>(EMULATOR_TURBO_SHARE / EMULATOR_FRAME_RATE);
+    const auto deadline = clock::now() + std::chrono::duration_cast<clock::duration>(budget);
+
+    uint32_t frames = 0;
+    do
+    {
+        m_instructions += m_chip8->RunFor(1.0 / EMULATOR_FRAME_RATE).cycles;
+        ++frames;
+    } while (clock::now() < deadline);
+    return frames;
+}
+
+void
+Emulator::RunAhead()
+{
+    // Show where the keys down now lead a few frames on, then go back to the present: the next
+    // frame runs from here, with whatever keys are down by then
+    m_chip8->SaveSnapshot(*m_snapshot);
+    m_chip8->SetSpeculative(true);
+    for (uint32_t i = 0; i < m_runAhead; ++i)
+    {
+        m_instructions += m_chip8->RunFor(1.0 / EMULATOR_FRAME_RATE).cycles;
+    }
+    m_chip8->SetSpeculative(false);
+    Publish();
+    m_chip8->RestoreSnapshot(*m_snapshot);
+}
+
+void
+Emulator::RunCommands()
+{
+    command_t command;
+    m_isKeyAnchored = false;
+    while (m_commands.Pop(command)) Execute(command);
+}
+
+void
+Emulator::Execute(const command_t &command)
+{
+    switch (command.action)
+    {
+        case action_t::LoadFile:
+        {
+            const std::string &name = command.filename;
+            std::string extension = name.substr(std::min(name.find_last_of('.'), name.size()));
+
+            // AOT modules run the ROM already loaded, from where it is
+            if (extension == ".so")
+            {
+                if (m_chip8->LoadAot(name.c_str())) m_chip8->SetBackend(Chip8::backend_t::Aot);
+                break;
+            }
+
+            m_latestFile = name;
+
+            // Pick the quirks the ROM was most likely written for
+            if (extension == ".sc8")      m_chip8->SetProfile(Chip8::profile_t::SuperChip);
+            else if (extension == ".xo8") m_chip8->SetProfile(Chip8::profile_t::XoChip);
+            else                          m_chip8->SetProfile(Chip8::profile_t::Chip0u);
+
+            m_chip8->LoadGame(name.c_str());
+            Disassemble();
+            m_isKeyAnchored = false;
+            break;
+        }
+        case action_t::Reset:
+        {
+            m_chip8->Reset();
+            m_chip8->LoadGame(m_latestFile.c_str());
+            Disassemble();
+            m_isKeyAnchored = false;
+            break;
+        }
+        case action_t::Step:
+        {
+            m_isPaused = true;
+            m_chip8->Run(1);
+            break;
+        }
+        case action_t::SetPaused:   m_isPaused = command.value != 0; break;
+        case action_t::SetSpeed:    m_chip8->SetClockRate(command.value * EMULATOR_FRAME_RATE); break;
+        case action_t::SetTurbo:    m_isTurbo = command.value != 0; break;
+        case action_t::SetRunAhead: m_runAhead = std::min<uint32_t>(command.value, EMULATOR_RUN_AHEAD_MAX); break;
+        case action_t::SetKey:
+        {
+            if (!m_isKeyAnchored)
+            {
+                m_keyTime = command.time;
+                m_keyCycle = m_chip8->GetCycles();
+                m_isKeyAnchored = true;
+            }
+
+            // No further than a frame on, so a batch that waited on a pause doesn't spread out
+            const std::chrono::duration<double> delay = command.time - m_keyTime;
+            const double seconds = std::min(delay.count(), 1.0 / EMULATOR_FRAME_RATE);
+            m_chip8->QueueKey(m_keyCycle + (uint64_t)(seconds * m_chip8->GetClockRate()), command.value >> 1, command.value & 1);
+            break;
+        }
+        case action_t::SetBackend:  m_chip8->SetBackend((Chip8::backend_t)command.value); break;
+        case action_t::SetProfile:  m_chip8->SetProfile((Chip8::profile_t)command.value); break;
+        default: break;
+    }
+}
+
+void
+Emulator::Disassemble()
+{
+    std::lock_guard<std::mutex> lock(m_disassembledMutex);
+    m_disassembled = m_chip8->GetDisassembled();
+    ++m_loads;
+}
+
+void
+Emulator::Publish()
+{
+    frame_t &frame = m_frames.GetBack();
+
+    m_chip8->GetFrame(frame.machine);
+    frame.backend = m_chip8->GetBackend();
+    frame.profile = m_chip8->GetProfile();
+    for (size_t i = 0; i < (size_t)Chip8::backend_t::Count; ++i)
+    {
+        frame.isBackendAvailable[i] = m_chip8->IsBackendAvailable((Chip8::backend_t)i);
+    }
+    for (size_t i = 0; i < (size_t)Chip8::fusion_t::Count; ++i)
+    {
+        frame.fusionCounts[i] = m_chip8->GetFusionCount((Chip8::fusion_t)i);
+    }
+    frame.codeShareCount = m_chip8->GetCodeShareCount();
+    frame.audioRate = m_chip8->GetAudioRate();
+    frame.isPaused = m_isPaused;
+    frame.isTurbo = m_isTurbo;
+    frame.speed = m_speed;
+    frame.runAhead = m_runAhead;
+    frame.instructions = m_instructions;
+    frame.loads = m_loads;
+
+    m_frames.Publish();
+}
@@ -0,0 +1,191 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_EMULATOR_H
+#define CHIP0U_EMULATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "chip8/Chip8.h"
+#include "sync/SpscQueue.h"
+#include "sync/TripleBuffer.h"
+
+// Frames emulated per second, each one 1/EMULATOR_FRAME_RATE seconds of guest time
+#define EMULATOR_FRAME_RATE 60
+
+// Queued commands before the sender waits for the emulation to take them
+#define EMULATOR_QUEUE_SIZE 256
+
+// Share of a frame turbo spends running the guest, leaving the rest to publish it and, without a
+// thread, to the UI
+#define EMULATOR_TURBO_SHARE 0.75
+
+// Seconds the achieved speed is averaged over
+#define EMULATOR_SPEED_WINDOW 0.5
+
+// Frames run-ahead shows past the current one, at most
+#define EMULATOR_RUN_AHEAD_MAX 4
+
+
+// Runs the CHIP-8 on a thread of its own, so a slow UI frame doesn't stall the emulation and a high
+// cycle rate doesn't stall the UI.
+//
+// Everything the UI changes goes through a queue of commands, run in order at the start of the next
+// frame; everything it shows comes from the frames published after each one, the newest taken by
+// Update(). Where there are no threads, Update() runs the frames itself.
+class Emulator
+{
+public:
+    // What the UI sees of the machine after a frame
+    typedef struct frame_t
+    {
+        Chip8::frame_t      machine;
+        Chip8::backend_t    backend;
+        Chip8::profile_t    profile;
+        bool                isBackendAvailable[(size_t)Chip8::backend_t::Count];
+        uint32_t            fusionCounts[(size_t)Chip8::fusion_t::Count];
+        uint32_t            codeShareCount;
+        float               audioRate;
+        bool                isPaused;
+        bool                isTurbo;
+        float               speed;          // Guest seconds run per second, 1 at full speed
+        uint32_t            runAhead;
+        uint32_t            instructions;   // Run for this frame, the frames run ahead included
+        uint32_t            loads;          // ROMs loaded or reloaded so far; GetDisassembled() changes with it
+    } frame_t;
+
+public:
+    Emulator();
+    ~Emulator();
+
+    // Run the frames on the emulation thread, until Stop()
+    void Start();
+    void Stop();
+
+    // Commands, run by the emulation in the order sent
+    void LoadFile(const std::string &filename);
+    void Reset();
+    void Step();
+    void SetPaused(bool isPaused);
+    void SetSpeed(uint32_t cycles);         // Per frame; the guest clock runs at EMULATOR_FRAME_RATE times that
+    void SetTurbo(bool isTurbo);            // Run as many frames as fit in each one, and publish the last
+    void SetRunAhead(uint32_t frames);      // Publish the machine this many frames ahead, with the keys down now
+    void SetKey(uint8_t key, bool isDown);
+    void SetBackend(Chip8::backend_t backend);
+    void SetProfile(Chip8::profile_t profile);
+
+    // Take the newest frame published, if any. Returns whether there was
+    bool Update();
+
+    // The frame taken by the last Update()
+    const frame_t& GetFrame() const;
+
+    // Instructions of the ROM loaded last
+    std::map<uint16_t, std::string> GetDisassembled() const;
+
+private:
+    enum class action_t : uint8_t
+    {
+        LoadFile,
+        Reset,
+        Step,
+        SetPaused,
+        SetSpeed,
+        SetTurbo,
+        SetRunAhead,
+        SetKey,
+        SetBackend,
+        SetProfile,
+
+        Count
+    };
+
+    typedef struct command_t
+    {
+        action_t    action;
+        uint32_t    value;
+        std::string filename;
+        std::chrono::steady_clock::time_point time;     // When sent, for keys
+    } command_t;
+
+    void Send(const command_t &command);
+
+    // Emulation thread: a frame every 1/EMULATOR_FRAME_RATE seconds
+    void Loop();
+
+    // One frame: the commands queued, the cycles unless paused, and the machine published
+    void Tick();
+    uint32_t RunFrames();   // Guest frames run
+    void RunAhead();
+    void RunCommands();
+    void Execute(const command_t &command);
+    void Disassemble();
+    void Publish();
+
+    // Emulation thread only
+    std::unique_ptr<Chip8> m_chip8;
+    std::string m_latestFile;
+    uint32_t    m_loads {0};
+    bool        m_isPaused {false};
+    bool        m_isTurbo {false};
+
+    // Frames to run ahead, from the snapshot they roll back to, and the instructions run this frame
+    uint32_t    m_runAhead {0};
+    std::unique_ptr<Chip8::snapshot_t> m_snapshot;
+    uint32_t    m_instructions {0};
+
+    // The first key of each batch of commands goes in at the current cycle, the others as far
+    // apart in guest time as they were sent
+    std::chrono::steady_clock::time_point m_keyTime;
+    uint64_t    m_keyCycle {0};
+    bool        m_isKeyAnchored {false};
+
+    // Guest frames run since the start of the speed window, and the speed over the last one
+    std::chrono::steady_clock::time_point m_speedStart {std::chrono::steady_clock::now()};
+    uint64_t    m_speedFrames {0};
+    float       m_speed {0.0F};
+
+    // Between the two threads
+    SpscQueue<command_t, EMULATOR_QUEUE_SIZE> m_commands;
+    TripleBuffer<frame_t> m_frames;
+
+    // Written on loads only, so a lock costs nothing worth avoiding
+    mutable std::mutex m_disassembledMutex;
+    std::map<uint16_t, std::string> m_disassembled;
+
+    std::thread       m_thread;
+    std::atomic<bool> m_isRunning {false};
+};
+
+inline const Emulator::frame_t&
+Emulator::GetFrame() const
+{
+    return m_frames.GetFront();
+}
+
+#endif //CHIP0U_EMULATOR_H
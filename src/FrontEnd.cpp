@@ -122,7 +122,7 @@ FrontEnd::DrawToolbar()
         if (menu_action == "Open")
         {
             m_app->SetPaused(true);
-            ImGuiFileDialog::Instance()->OpenDialog("ChooseFileDlgKey", "Choose a ROM", ".ch8,.rom", m_dialogConfig);
+            ImGuiFileDialog::Instance()->OpenDialog("ChooseFileDlgKey", "Choose a ROM", ".ch8,.sc8,.xo8,.rom,.so", m_dialogConfig);
         }
 
         ImVec2 maxSize = ImVec2(m_app->m_displayWidth, m_app->m_displayHeight);
@@ -138,7 +138,7 @@ FrontEnd::DrawToolbar()
             }
 
             // close
-            m_app->m_isPaused = false;
+            m_app->SetPaused(false);
             ImGuiFileDialog::Instance()->Close();
         }
     }
@@ -149,7 +149,7 @@ FrontEnd::DrawToolbar()
         ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
         if (ImGui::BeginPopupModal("About", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoMove))
         {
-            m_app->m_isPaused = true;
+            m_app->SetPaused(true);
 
             ImGui::SetItemDefaultFocus();
 
@@ -164,7 +164,7 @@ FrontEnd::DrawToolbar()
             if (ImGui::Button("Close"))
             {
                 ImGui::CloseCurrentPopup();
-                m_app->m_isPaused = false;
+                m_app->SetPaused(false);
             }
             ImGui::EndPopup();
         }
@@ -208,7 +208,6 @@ FrontEnd::DrawControls()
     auto debugWindowFlags = ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize |
                             ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoSavedSettings;
 
-    Chip8 *chip8 = m_app->m_chip8;
     std::string menu_action{};
 
     // New window for the buttons
@@ -219,7 +218,7 @@ FrontEnd::DrawControls()
         {
             if (ImGui::Button(ICON_FA_PLAY))
             {
-                m_app->m_isPaused = false;
+                m_app->SetPaused(false);
             }
             if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
             {
@@ -230,7 +229,7 @@ FrontEnd::DrawControls()
         {
             if (ImGui::Button(ICON_FA_PAUSE))
             {
-                m_app->m_isPaused = true;
+                m_app->SetPaused(true);
             }
             if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
             {
@@ -242,8 +241,8 @@ FrontEnd::DrawControls()
         ImGui::SameLine();
         if (ImGui::Button(ICON_FA_RIGHT_TO_BRACKET))
         {
-            m_app->m_isPaused = true;
-            chip8->Clock();
+            m_app->SetPaused(true);
+            m_app->m_emulator->Step();
         }
         if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
         {
@@ -361,6 +360,63 @@ FrontEnd::DrawExtraControls()
             ImGui::SetTooltip("Duration of the lerp effect");
         }
 
+        // Blend of the last frames, against sprites flickering as they are erased and drawn again
+        const Deflicker &deflicker = m_app->m_deflicker;
+        if (ImGui::BeginCombo("Deflicker", Deflicker::GetModeName(deflicker.GetMode())))
+        {
+            for (int i = 0; i < (int)Deflicker::mode_t::Count; ++i)
+            {
+                auto mode = (Deflicker::mode_t)i;
+                bool isSelected = (deflicker.GetMode() == mode);
+                if (ImGui::Selectable(Deflicker::GetModeName(mode), isSelected))
+                {
+                    m_app->SetDeflicker(mode, deflicker.GetFrames());
+                }
+                if (isSelected)
+                {
+                    ImGui::SetItemDefaultFocus();
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+        {
+            ImGui::SetTooltip("Pixels shown lit: any lit in the last frames, or those lit in at least half of them");
+        }
+
+        int frames = (int)deflicker.GetFrames();
+        if (ImGui::SliderInt("Deflicker Frames", &frames, 2, DEFLICKER_FRAMES))
+        {
+            m_app->SetDeflicker(deflicker.GetMode(), frames);
+        }
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("Frames blended by the deflicker");
+        }
+
+        // Upscaling filter
+        if (ImGui::BeginCombo("Filter", Upscaler::GetFilterName(m_app->m_upscaler.GetFilter())))
+        {
+            for (int i = 0; i < (int)Upscaler::filter_t::Count; ++i)
+            {
+                auto filter = (Upscaler::filter_t)i;
+                bool isSelected = (m_app->m_upscaler.GetFilter() == filter);
+                if (ImGui::Selectable(Upscaler::GetFilterName(filter), isSelected))
+                {
+                    m_app->SetFilter(filter);
+                }
+                if (isSelected)
+                {
+                    ImGui::SetItemDefaultFocus();
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+        {
+            ImGui::SetTooltip("How the display is scaled up to the window");
+        }
+
         // Cycles per frame
         if (ImGui::BeginCombo("Speed", std::to_string(m_app->m_speeds[m_app->m_emulation_cfg.speed]).c_str()))
         {
@@ -370,7 +426,93 @@ FrontEnd::DrawExtraControls()
                 std::string speeds = std::to_string(m_app->m_speeds[i]) + " cycles/frame";
                 if (ImGui::Selectable(speeds.c_str(), isSelected))
                 {
-                    m_app->m_emulation_cfg.speed = i;
+                    m_app->SetSpeed(i);
+                }
+                if (isSelected)
+                {
+                    ImGui::SetItemDefaultFocus();
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+        {
+            ImGui::SetTooltip("Cycles per frame; the timers tick 60 times a second at any speed");
+        }
+
+        // Turbo, and the speed the emulation keeps up
+        const Emulator::frame_t &frame = m_app->m_emulator->GetFrame();
+        bool isTurbo = m_app->m_isTurbo;
+        if (ImGui::Checkbox("Turbo (Tab)", &isTurbo))
+        {
+            m_app->SetTurbo(isTurbo);
+        }
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+        {
+            ImGui::SetTooltip("Run as many frames as the host can, showing one in each");
+        }
+        ImGui::SameLine();
+        ImGui::Text("x%.1f", frame.speed);
+
+        // Frames shown ahead of the machine, and what it costs
+        const std::string runAhead = m_app->m_emulation_cfg.run_ahead == 0 ? "Off" : std::to_string(m_app->m_emulation_cfg.run_ahead) + " frames";
+        if (ImGui::BeginCombo("Run-ahead", runAhead.c_str()))
+        {
+            for (uint32_t i = 0; i <= EMULATOR_RUN_AHEAD_MAX; ++i)
+            {
+                bool isSelected = (m_app->m_emulation_cfg.run_ahead == i);
+                std::string label = i == 0 ? "Off" : std::to_string(i) + " frames";
+                if (ImGui::Selectable(label.c_str(), isSelected))
+                {
+                    m_app->SetRunAhead(i);
+                }
+                if (isSelected)
+                {
+                    ImGui::SetItemDefaultFocus();
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+        {
+            ImGui::SetTooltip("Show the frames a key press leads to this many frames early.\n%u instructions run for the last frame",
+                              frame.instructions);
+        }
+
+        // Execution backend
+        if (ImGui::BeginCombo("Backend", Chip8::GetBackendName(frame.backend)))
+        {
+            for (int i = 0; i < (int)Chip8::backend_t::Count; ++i)
+            {
+                auto backend = (Chip8::backend_t)i;
+                bool isSelected = (frame.backend == backend);
+                auto flags = frame.isBackendAvailable[i] ? ImGuiSelectableFlags_None : ImGuiSelectableFlags_Disabled;
+                if (ImGui::Selectable(Chip8::GetBackendName(backend), isSelected, flags))
+                {
+                    m_app->m_emulator->SetBackend(backend);
+                }
+                if (isSelected)
+                {
+                    ImGui::SetItemDefaultFocus();
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+        {
+            ImGui::SetTooltip("How the CHIP-8 code is executed");
+        }
+
+        // Quirk profile
+        if (ImGui::BeginCombo("Quirks", Chip8::GetQuirks(frame.profile).name))
+        {
+            for (int i = 0; i < (int)Chip8::profile_t::Count; ++i)
+            {
+                auto profile = (Chip8::profile_t)i;
+                bool isSelected = (frame.profile == profile);
+                if (ImGui::Selectable(Chip8::GetQuirks(profile).name, isSelected))
+                {
+                    m_app->m_emulator->SetProfile(profile);
                 }
                 if (isSelected)
                 {
@@ -381,7 +523,18 @@ FrontEnd::DrawExtraControls()
         }
         if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
         {
-            ImGui::SetTooltip("Cycles per frame");
+            ImGui::SetTooltip("Interpreter behaviour the ROM expects");
+        }
+
+        // Superinstructions made by the block cache for this ROM
+        if (frame.backend == Chip8::backend_t::BlockCache)
+        {
+            for (int i = 0; i < (int)Chip8::fusion_t::Count; ++i)
+            {
+                auto fusion = (Chip8::fusion_t)i;
+                ImGui::Text("%-16s %u", Chip8::GetFusionName(fusion), frame.fusionCounts[i]);
+            }
+            ImGui::Text("%-16s %u", "Shared by", frame.codeShareCount);
         }
 
         // Close button
@@ -394,7 +547,8 @@ FrontEnd::DrawExtraControls()
 void
 FrontEnd::DrawRegisters()
 {
-    Chip8 *chip8 = m_app->m_chip8;
+    const Emulator::frame_t &frame = m_app->m_emulator->GetFrame();
+    const Chip8::chip8_t &state = frame.machine.state;
 
     auto debugWindowFlags = ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize |
                             ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoSavedSettings;
@@ -402,11 +556,19 @@ FrontEnd::DrawRegisters()
     ImGui::SetNextWindowPos(ImVec2(64 * 10, 70), ImGuiCond_Always);
     ImGui::SetNextWindowSize(ImVec2(m_app->m_uiDisplacement * 0.4F, 120), ImGuiCond_Always);
     ImGui::Begin("Registers", nullptr, debugWindowFlags);
-        ImGui::Text("PC: #%s\t[%d]", HEX(chip8->GetPC(), 3).c_str(), chip8->GetPC());
-        ImGui::Text("I : #%s\t[%d]", HEX(chip8->GetI(), 3).c_str(), chip8->GetI());
-        ImGui::Text("SP: #%s\t[%d]", HEX(chip8->GetSP(), 1).c_str(), chip8->GetSP());
-        ImGui::Text("DT: #%s\t[%d]", HEX(chip8->GetDelayTimer(), 1).c_str(), chip8->GetDelayTimer());
-        ImGui::Text("ST: #%s\t[%d]", HEX(chip8->GetSoundTimer(), 1).c_str(), chip8->GetSoundTimer());
+        ImGui::Text("PC: #%s\t[%d]", HEX(state.PC, 3).c_str(), state.PC);
+        ImGui::Text("I : #%s\t[%d]", HEX(state.I, 4).c_str(), state.I);
+        ImGui::Text("SP: #%s\t[%d]", HEX(state.SP, 1).c_str(), state.SP);
+        ImGui::Text("DT: #%s\t[%d]", HEX(state.DT, 1).c_str(), state.DT);
+        ImGui::Text("ST: #%s\t[%d]", HEX(state.ST, 1).c_str(), state.ST);
+        ImGui::Text("DP: %ux%u", frame.machine.width, frame.machine.height);
+
+        // XO-CHIP planes selected and audio rate
+        if (Chip8::GetQuirks(frame.profile).xo_chip)
+        {
+            ImGui::SameLine();
+            ImGui::Text("\tPL: #%s\t[%.0f Hz]", HEX(state.PLANES, 1).c_str(), frame.audioRate);
+        }
     ImGui::End();
 }
 
@@ -419,7 +581,7 @@ FrontEnd::DrawStack()
     ImGui::SetNextWindowPos(ImVec2((64 * 10) + m_app->m_uiDisplacement * 0.4F, 20), ImGuiCond_Always);
     ImGui::SetNextWindowSize(ImVec2(m_app->m_uiDisplacement * 0.25F, 170), ImGuiCond_Always);
     ImGui::Begin("Stack", nullptr, debugWindowFlags);
-        auto stack = m_app->m_chip8->GetStack();
+        auto stack = m_app->m_emulator->GetFrame().machine.state.STACK;
         for (int i = 0; i < 16; ++i)
         {
             ImGui::Text("%s: #%s", HEX(i, 1).c_str(), HEX(stack[i], 3).c_str());
@@ -435,12 +597,21 @@ FrontEnd::DrawDataRegisters()
 
     ImGui::SetNextWindowPos(ImVec2((64 * 10) + m_app->m_uiDisplacement * 0.65F, 20), ImGuiCond_Always);
     ImGui::SetNextWindowSize(ImVec2(m_app->m_uiDisplacement * 0.35F, 170), ImGuiCond_Always);
+    const Emulator::frame_t &frame = m_app->m_emulator->GetFrame();
     ImGui::Begin("V0~VF", nullptr, debugWindowFlags);
         for (int i = 0; i < 16; ++i)
         {
-            uint8_t v = m_app->m_chip8->GetV()[i];
+            uint8_t v = frame.machine.state.V[i];
             ImGui::Text("V%X: #%s [%d]", i, HEX(v, 2).c_str(), v);
         }
+
+        // SUPER-CHIP flag registers
+        if (Chip8::GetQuirks(frame.profile).super_chip)
+        {
+            ImGui::Separator();
+            const uint8_t* rpl = frame.machine.state.RPL;
+            for (int i = 0; i < RPL_SIZE; ++i) ImGui::Text("R%X: #%s [%d]", i, HEX(rpl[i], 2).c_str(), rpl[i]);
+        }
     ImGui::End();
 }
 
@@ -449,8 +620,8 @@ FrontEnd::DrawMemory()
 {
     if (!ImGui::BeginTabItem("Memory")) return;
 
-    static char start[4] = "000";
-    static char end[4] = "FFF";
+    static char start[5] = "000";
+    static char end[5] = "FFF";
 
     if (ImGui::TabItemButton(ICON_FA_CIRCLE_QUESTION, ImGuiTabItemFlags_Leading | ImGuiTabItemFlags_NoTooltip))
         ImGui::OpenPopup("DebugHelper");
@@ -472,16 +643,16 @@ FrontEnd::DrawMemory()
     }
 
     uint32_t start_val = strlen(start) != 0 ? std::stoul(start, nullptr, 16) : 0;
-    uint32_t end_val = strlen(end) != 0 ? std::stoul(end, nullptr, 16) : 4096;
+    uint32_t end_val = strlen(end) != 0 ? std::stoul(end, nullptr, 16) : CODE_SIZE;
 
     // Clamp the values to valid memory range
-    start_val = std::max(0u, std::min(start_val, 4096u));
-    end_val = std::max(0u, std::min(end_val, 4096u));
+    start_val = std::max(0u, std::min(start_val, (uint32_t)TOTAL_RAM));
+    end_val = std::max(0u, std::min(end_val, (uint32_t)TOTAL_RAM));
 
-    auto memory = m_app->m_chip8->GetMemory();
+    auto memory = m_app->m_emulator->GetFrame().machine.state.RAM;
     for (uint32_t i = start_val; i < end_val; i += 16)
     {
-        std::string s = HEX(i, 3) + ": ";
+        std::string s = HEX(i, 4) + ": ";
         ImGui::TextUnformatted(s.c_str());
         ImGui::SameLine();
         for (int j = 0; j < std::min(16u, end_val - i + 1); ++j)
@@ -530,18 +701,23 @@ FrontEnd::DrawInput()
         ImGui::EndPopup();
     }
 
-    Chip8 *chip8 = m_app->m_chip8;
-    auto keys = chip8->GetKeyboard();
+    auto keys = m_app->m_emulator->GetFrame().machine.state.KP;
     auto flags = ImGuiButtonFlags_PressedOnClick | ImGuiButtonFlags_Repeat;
 
     uint8_t i = 0;
     for (const auto &keypair : m_uiKeys)
     {
-        ImVec4 buttonColor = keys[keypair.first] ? ImVec4(0.0f, 1.0f, 0.0f, 1.0f) : ImVec4(1.0f, 0.0f, 0.0f, 1.0f);
+        ImVec4 buttonColor = (keys >> keypair.first & 1) ? ImVec4(0.0f, 1.0f, 0.0f, 1.0f) : ImVec4(1.0f, 0.0f, 0.0f, 1.0f);
         ImGui::PushStyleColor(ImGuiCol_Button, buttonColor);
 
-        bool isPressed = ImGui::ButtonEx(keypair.second, ImVec2(24, 24), flags);
-        chip8->SetKey(keypair.first, isPressed);
+        ImGui::ButtonEx(keypair.second, ImVec2(24, 24), flags);
+        const uint16_t bit = 1 << keypair.first;
+        const bool isPressed = ImGui::IsItemActive();
+        if (isPressed != ((m_uiKeysDown & bit) != 0))
+        {
+            m_uiKeysDown ^= bit;
+            m_app->SetKey(keypair.first, isPressed);
+        }
 
         ImGui::PopStyleColor();
 
@@ -580,7 +756,7 @@ FrontEnd::DrawDisassembly()
     }
 
     {
-        int pc = m_app->m_chip8->GetPC();
+        int pc = m_app->m_emulator->GetFrame().machine.state.PC;
         int start = std::max(0, pc - 10);
         int end = std::min(4096, pc + 10);
 
@@ -86,6 +86,9 @@ private:
         {0x7, "7"}, {0x8, "8"}, {0x9, "9"}, {0xE, "E"},
         {0xA, "A"}, {0x0, "0"}, {0xB, "B"}, {0xF, "F"}
     };
+
+    // Keys held on the UI keypad, one bit each; only changes are sent to the emulation
+    uint16_t m_uiKeysDown {0};
 };
 
 inline bool
@@ -0,0 +1,149 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Aot.h"
+
+#include "CodeCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(CHIP0U_AOT)
+#include <dlfcn.h>
+#endif
+
+
+Aot::Aot()
+{
+}
+
+Aot::~Aot()
+{
+    Unload();
+}
+
+
+
+bool
+Aot::Load(const char* path)
+{
+    Unload();
+
+#if defined(CHIP0U_AOT)
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr)
+    {
+        printf("AOT: %s\n", dlerror());
+        return false;
+    }
+
+    auto getter = (aot_module_getter_t)dlsym(handle, AOT_MODULE_SYMBOL);
+    const aot_module_t *module = getter != nullptr ? getter() : nullptr;
+    if (module == nullptr)
+    {
+        printf("AOT: %s is not a Chip0u module\n", path);
+        dlclose(handle);
+        return false;
+    }
+
+    if (module->version != AOT_ABI_VERSION || module->stateSize != sizeof(Chip8::chip8_t)
+        || module->profile >= (uint8_t)Chip8::profile_t::Count)
+    {
+        printf("AOT: %s was built for another version of Chip0u\n", path);
+        dlclose(handle);
+        return false;
+    }
+
+    m_handle = handle;
+    m_module = module;
+
+    m_lengths.assign(CODE_SIZE, 0);
+    m_valid.assign(CODE_SIZE, 0);
+
+    for (uint32_t i = 0; i < module->blockCount; ++i)
+    {
+        const aot_block_info_t &block = module->blocks[i];
+        if (block.start >= CODE_SIZE || block.length == 0 || block.length > MAX_BLOCK_LENGTH) continue;
+
+        m_lengths[block.start] = block.length;
+    }
+
+    return true;
+#else
+    printf("AOT: modules can't be loaded on this platform (%s)\n", path);
+    return false;
+#endif
+}
+
+void
+Aot::Unload()
+{
+#if defined(CHIP0U_AOT)
+    if (m_handle != nullptr) dlclose(m_handle);
+#endif
+
+    m_handle = nullptr;
+    m_module = nullptr;
+
+    // Tables only exist while a module is loaded
+    std::vector<uint8_t>().swap(m_lengths);
+    std::vector<uint8_t>().swap(m_valid);
+}
+
+void
+Aot::Validate(const uint8_t* ram)
+{
+    if (m_module == nullptr) return;
+
+    std::fill(m_valid.begin(), m_valid.end(), 0);
+    uint32_t imageEnd = m_module->imageStart + m_module->imageSize;
+    for (uint32_t pc = 0; pc < CODE_SIZE; ++pc)
+    {
+        uint32_t end = pc + m_lengths[pc] * 2;
+        if (m_lengths[pc] == 0 || pc < m_module->imageStart || end > imageEnd || end > CODE_SIZE) continue;
+
+        m_valid[pc] = memcmp(ram + pc, m_module->image + (pc - m_module->imageStart), end - pc) == 0;
+    }
+}
+
+uint32_t
+Aot::Execute(Chip8::chip8_t &c8, uint32_t cycles)
+{
+    if (c8.PC >= CODE_SIZE || !m_valid[c8.PC]) return 0;
+
+    uint32_t left = m_module->run(&c8, cycles, m_valid.data());
+    return cycles - left;
+}
+
+void
+Aot::Invalidate(uint16_t addr, uint16_t size)
+{
+    if (m_module == nullptr) return;
+
+    // Any block starting up to MAX_BLOCK_LENGTH instructions before may run over the write
+    uint32_t end = std::min<uint32_t>(addr + size, CODE_SIZE);
+    uint32_t first = addr > MAX_BLOCK_LENGTH * 2 ? addr - MAX_BLOCK_LENGTH * 2 : 0;
+    for (uint32_t pc = first; pc < end; ++pc)
+    {
+        if (m_valid[pc] && pc + m_lengths[pc] * 2 > addr) m_valid[pc] = 0;
+    }
+}
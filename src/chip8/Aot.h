@@ -0,0 +1,123 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_AOT_H
+#define CHIP0U_AOT_H
+
+#include <vector>
+
+#include "Chip8.h"
+
+// Modules are loaded with dlopen
+#if defined(__unix__) && !defined(__EMSCRIPTEN__)
+#define CHIP0U_AOT 1
+#endif
+
+// Bumped whenever the module layout or the block calling convention changes
+#define AOT_ABI_VERSION 7
+
+// Symbol every module exports
+#define AOT_MODULE_SYMBOL "chip0u_aot_module"
+
+
+// Interface shared by the emulator and the modules written by the Recompiler.
+//
+// A module runs the basic blocks of a ROM from the current PC, in a single function. Blocks run
+// while the budget covers them and carry on into the next block; the budget left comes back,
+// with the PC written back, as soon as they reach code only the interpreter handles. `valid`
+// has one flag per address and tells which blocks still match memory, so a block never carries
+// on into code that was overwritten since.
+typedef uint32_t (*aot_run_t)(Chip8::chip8_t *c8, uint32_t budget, const uint8_t *valid);
+
+typedef struct aot_block_info_t
+{
+    uint16_t    start;          // Address of the first instruction
+    uint8_t     length;         // Instructions in the block
+} aot_block_info_t;
+
+typedef struct aot_module_t
+{
+    uint32_t    version;        // AOT_ABI_VERSION
+    uint32_t    stateSize;      // sizeof(Chip8::chip8_t) the module was built against
+    uint8_t     profile;        // Chip8::profile_t the instructions follow
+
+    // ROM image the blocks were translated from, loaded at `imageStart`
+    uint16_t        imageStart;
+    uint16_t        imageSize;
+    const uint8_t  *image;
+
+    const aot_block_info_t *blocks;
+    uint32_t                blockCount;
+    aot_run_t               run;
+} aot_module_t;
+
+typedef const aot_module_t* (*aot_module_getter_t)();
+
+
+// Runs the blocks of a module loaded at runtime
+class Aot
+{
+public:
+    Aot();
+    ~Aot();
+
+    // Load a module, replacing the current one. Returns false, with the reason printed, on failure
+    bool Load(const char* path);
+    void Unload();
+
+    bool IsLoaded() const;
+    Chip8::profile_t GetProfile() const;
+
+    // Compare every block with memory; blocks that don't match are left to the interpreter
+    void Validate(const uint8_t* ram);
+
+    // Run blocks from the current PC, for at most `cycles` instructions.
+    // Returns the number of instructions executed; 0 means the interpreter has to take over
+    uint32_t Execute(Chip8::chip8_t &c8, uint32_t cycles);
+
+    // Stop using every block overlapping [addr, addr + size)
+    void Invalidate(uint16_t addr, uint16_t size);
+
+private:
+    void *m_handle {nullptr};
+    const aot_module_t *m_module {nullptr};
+
+    // Length of the block at each address, 0 where none starts. Empty until a module is loaded
+    std::vector<uint8_t>     m_lengths;
+
+    // Blocks matching memory, handed to the module
+    std::vector<uint8_t>     m_valid;
+};
+
+inline bool
+Aot::IsLoaded() const
+{
+    return m_module != nullptr;
+}
+
+inline Chip8::profile_t
+Aot::GetProfile() const
+{
+    return m_module != nullptr ? (Chip8::profile_t)m_module->profile : Chip8::profile_t::Count;
+}
+
+#endif //CHIP0U_AOT_H
@@ -22,9 +22,16 @@
 
 #include "Chip8.h"
 
+#include "Aot.h"
+#include "CodeCache.h"
+#include "Jit.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
 #include <random>
 
-#include <chrono>
 #include <iostream>
 
 static constexpr uint8_t FONT_SET[FONT_SET_SIZE]
@@ -47,45 +54,121 @@ static constexpr uint8_t FONT_SET[FONT_SET_SIZE]
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+static constexpr uint8_t BIG_FONT_SET[BIG_FONT_SIZE]
+{
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
 
-Chip8::Chip8()
+
+template <typename Q>
+constexpr Chip8::dispatch_table_t
+Chip8::BuildDispatchTable()
 {
-    // Populate instructions map
     using c8 = Chip8;
-    m_lookup =
-    {
-        /** Clearing and Returning Instructions */
-        {0x00E0, {"CLS", &c8::OP_00E0}}, {0x00EE, {"RET", &c8::OP_00EE}},
-        /** Jump Instructions */
-        {0x1000, {"JP", &c8::OP_1NNN}},
-        /** Call Instructions */
-        {0x2000, {"CALL", &c8::OP_2NNN}},
-        /** Skip Instructions */
-        {0x3000, {"SE", &c8::OP_3XNN}}, {0x4000, {"SNE", &c8::OP_4XNN}}, {0x5000, {"SE", &c8::OP_5XY0}},
-        /** Load and Add Instructions */
-        {0x6000, {"LD", &c8::OP_6XNN}}, {0x7000, {"ADD", &c8::OP_7XNN}},
-        /** Register Instructions */
-        {0x8000, {"LD", &c8::OP_8XY0}}, {0x8001, {"OR", &c8::OP_8XY1}}, {0x8002, {"AND", &c8::OP_8XY2}}, {0x8003, {"XOR", &c8::OP_8XY3}}, {0x8004, {"ADD", &c8::OP_8XY4}}, {0x8005, {"SUB", &c8::OP_8XY5}}, {0x8006, {"SHR", &c8::OP_8XY6}}, {0x8007, {"SUBN", &c8::OP_8XY7}}, {0x800E, {"SHL", &c8::OP_8XYE}},
-        /** Skip Instructions */
-        {0x9000, {"SNE", &c8::OP_9XY0}},
-        /** Load Instructions */
-        {0xA000, {"LD", &c8::OP_ANNN}},
-        /** Jump Instructions */
-        {0xB000, {"JP", &c8::OP_BNNN}},
-        /** Random Number Instructions */
-        {0xC000, {"RND", &c8::OP_CXNN}},
-        /** Draw Instructions */
-        {0xD000, {"DRW", &c8::OP_DXYN}},
-        /** Skip Instructions */
-        {0xE09E, {"SKP", &c8::OP_EX9E}}, {0xE0A1, {"SKNP", &c8::OP_EXA1}},
-        /** Timer and Load Instructions */
-        {0xF007, {"LD", &c8::OP_FX07}}, {0xF00A, {"LD", &c8::OP_FX0A}}, {0xF015, {"LD", &c8::OP_FX15}}, {0xF018, {"LD", &c8::OP_FX18}}, {0xF01E, {"ADD", &c8::OP_FX1E}}, {0xF029, {"LD", &c8::OP_FX29}}, {0xF033, {"LD", &c8::OP_FX33}}, {0xF055, {"LD", &c8::OP_FX55}}, {0xF065, {"LD", &c8::OP_FX65}}
+    dispatch_table_t table{};
+
+    // Every opcode owns the 256 entries of its first nibble; the masked ones narrow it down
+    auto any = [&table](uint8_t nibble, const char* name, void (Chip8::*fn)())
+    {
+        for (uint16_t lo = 0; lo < 0x100; ++lo) table[nibble << 8 | lo] = {name, fn};
+    };
+
+    // Matches on the last nibble only (8XYN)
+    auto last = [&table](uint8_t nibble, uint8_t n, const char* name, void (Chip8::*fn)())
+    {
+        for (uint16_t y = 0; y < 0x10; ++y) table[nibble << 8 | y << 4 | n] = {name, fn};
     };
 
+    // Matches on the whole low byte (0NNN, EXNN, FXNN)
+    auto byte = [&table](uint16_t opcode, const char* name, void (Chip8::*fn)())
+    {
+        table[GetDispatchIndex(opcode)] = {name, fn};
+    };
+
+    /** Clearing and Returning Instructions */
+    byte(0x00E0, "CLS", &c8::OP_00E0); byte(0x00EE, "RET", &c8::OP_00EE);
+    /** Jump Instructions */
+    any(0x1, "JP", &c8::OP_1NNN);
+    /** Call Instructions */
+    any(0x2, "CALL", &c8::OP_2NNN);
+    /** Skip Instructions */
+    any(0x3, "SE", &c8::OP_3XNN<Q>); any(0x4, "SNE", &c8::OP_4XNN<Q>); any(0x5, "SE", &c8::OP_5XY0<Q>);
+    /** Load and Add Instructions */
+    any(0x6, "LD", &c8::OP_6XNN); any(0x7, "ADD", &c8::OP_7XNN);
+    /** Register Instructions */
+    last(0x8, 0x0, "LD", &c8::OP_8XY0); last(0x8, 0x1, "OR", &c8::OP_8XY1<Q>); last(0x8, 0x2, "AND", &c8::OP_8XY2<Q>); last(0x8, 0x3, "XOR", &c8::OP_8XY3<Q>); last(0x8, 0x4, "ADD", &c8::OP_8XY4); last(0x8, 0x5, "SUB", &c8::OP_8XY5); last(0x8, 0x6, "SHR", &c8::OP_8XY6<Q>); last(0x8, 0x7, "SUBN", &c8::OP_8XY7); last(0x8, 0xE, "SHL", &c8::OP_8XYE<Q>);
+    /** Skip Instructions */
+    any(0x9, "SNE", &c8::OP_9XY0<Q>);
+    /** Load Instructions */
+    any(0xA, "LD", &c8::OP_ANNN);
+    /** Jump Instructions */
+    any(0xB, "JP", &c8::OP_BNNN<Q>);
+    /** Random Number Instructions */
+    any(0xC, "RND", &c8::OP_CXNN);
+    /** Draw Instructions */
+    any(0xD, "DRW", &c8::OP_DXYN<Q>);
+    /** Skip Instructions */
+    byte(0xE09E, "SKP", &c8::OP_EX9E<Q>); byte(0xE0A1, "SKNP", &c8::OP_EXA1<Q>);
+    /** Timer and Load Instructions */
+    byte(0xF007, "LD", &c8::OP_FX07); byte(0xF00A, "LD", &c8::OP_FX0A); byte(0xF015, "LD", &c8::OP_FX15); byte(0xF018, "LD", &c8::OP_FX18); byte(0xF01E, "ADD", &c8::OP_FX1E<Q>); byte(0xF029, "LD", &c8::OP_FX29); byte(0xF033, "LD", &c8::OP_FX33); byte(0xF055, "LD", &c8::OP_FX55<Q>); byte(0xF065, "LD", &c8::OP_FX65<Q>);
+
+    /** SUPER-CHIP Instructions */
+    if constexpr (Q::value.super_chip)
+    {
+        for (uint8_t n = 0; n < 0x10; ++n) byte(0x00C0 | n, "SCD", &c8::OP_00CN);
+        byte(0x00FB, "SCR", &c8::OP_00FB); byte(0x00FC, "SCL", &c8::OP_00FC); byte(0x00FD, "EXIT", &c8::OP_00FD); byte(0x00FE, "LOW", &c8::OP_00FE); byte(0x00FF, "HIGH", &c8::OP_00FF);
+        last(0xD, 0x0, "DRW", &c8::OP_DXY0<Q>);
+        byte(0xF030, "LD", &c8::OP_FX30); byte(0xF075, "LD", &c8::OP_FX75); byte(0xF085, "LD", &c8::OP_FX85);
+    }
+
+    /** XO-CHIP Instructions */
+    if constexpr (Q::value.xo_chip)
+    {
+        for (uint8_t n = 0; n < 0x10; ++n) byte(0x00D0 | n, "SCU", &c8::OP_00DN);
+        last(0x5, 0x2, "LD", &c8::OP_5XY2); last(0x5, 0x3, "LD", &c8::OP_5XY3);
+        byte(0xF000, "LD", &c8::OP_F000); byte(0xF001, "PLANE", &c8::OP_FN01); byte(0xF002, "AUDIO", &c8::OP_F002); byte(0xF03A, "PITCH", &c8::OP_FX3A);
+    }
+
+    return table;
+}
+
+// In profile_t order
+constexpr Chip8::dispatch_table_t Chip8::s_dispatch[] =
+{
+    BuildDispatchTable<Chip0uQuirks>(),
+    BuildDispatchTable<Chip8Quirks>(),
+    BuildDispatchTable<SuperChipQuirks>(),
+    BuildDispatchTable<XoChipQuirks>()
+};
+
+
+Chip8::Chip8()
+    : m_cache(std::make_unique<CodeCache>(m_c8.RAM))
+    , m_jit(std::make_unique<Jit>())
+    , m_aot(std::make_unique<Aot>())
+    , m_rng(std::random_device{}())
+{
     // Initialize the Chip8
     Reset();
 }
 
+Chip8::~Chip8() = default;
+
 
 
 void
@@ -123,23 +206,48 @@ Chip8::LoadGame(const char* filename)
     }
 
     // Copy the buffer into the Chip8 memory
-    if ((4096 - 512) > size)
+    if ((TOTAL_RAM - PROG_START) >= size)
     {
         for (int i = 0; i < size; ++i)
         {
-            m_c8.RAM[i + 512] = buffer[i];
+            m_c8.RAM[i + PROG_START] = buffer[i];
         }
     }
     else
     {
         printf("Error: ROM too big for memory\n");
-        printf("Oversize: %ld\n", size - (4096 - 512));
-        printf("ROM size: %ld, Memory size: %d\n", size, 4096 - 512);
+        printf("Oversize: %ld\n", size - (TOTAL_RAM - PROG_START));
+        printf("ROM size: %ld, Memory size: %d\n", size, TOTAL_RAM - PROG_START);
     }
 
     // Close the file and free the buffer
     fclose(file);
     free(buffer);
+
+    // Find out which translated blocks match the ROM
+    m_aot->Validate(m_c8.RAM);
+}
+
+void
+Chip8::WriteMemory(uint16_t addr, const uint8_t* data, uint16_t size)
+{
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        m_c8.RAM[(addr + i) % TOTAL_RAM] = data[i];
+    }
+
+    // Same as self-modifying code, which snapshots keep track of too
+    InvalidateCode(addr, size);
+}
+
+bool
+Chip8::LoadAot(const char* filename)
+{
+    if (!m_aot->Load(filename)) return false;
+
+    SetProfile(m_aot->GetProfile());
+    m_aot->Validate(m_c8.RAM);
+    return true;
 }
 
 void
@@ -147,35 +255,758 @@ Chip8::Clock()
 {
     // Fetch current instruction
     {
-        m_instr = instruction_t(m_c8.RAM[m_c8.PC] << 8 | m_c8.RAM[m_c8.PC + 1]);
+        m_instr = instruction_t(m_c8.RAM[m_c8.PC] << 8 | m_c8.RAM[(m_c8.PC + 1) % TOTAL_RAM]);
 
         m_c8.PC += 2; // Move to next instruction
     }
 
     // Decode opcode
     {
-        // Remap opcodes to instructions map
-        // Necessary because some opcodes are masked in the instructions map
-        // Maybe there's another way to do this, but... nhe... vamo deixá assim memo
-        uint16_t masked_opcode = GetMaskedOpcode(m_instr.OP);
+        // Unknown opcodes have no function and are skipped
+        const instruction_map_t &entry = (*m_dispatch)[GetDispatchIndex(m_instr.OP)];
 
         // Execute instruction
-        auto it = m_lookup.find(masked_opcode);
-        if (it != m_lookup.end())
+        if (entry.function != nullptr)
+        {
+            (this->*entry.function)();
+        }
+    }
+
+    UpdateTimers();
+}
+
+Chip8::run_t
+Chip8::Run(uint32_t cycles, uint32_t stops)
+{
+    m_stops = stops;
+    m_stop = stop_t::Budget;
+
+    // Only the interpreter looks at every PC
+    backend_t backend = m_backend;
+    if ((stops & GetStopMask(stop_t::Breakpoint)) && !m_breakpoints.empty()) backend = backend_t::Interpreter;
+
+    // Backends only see the keys between calls, so a run stops at each key due in it
+    uint32_t executed = 0;
+    do
+    {
+        ApplyKeys();
+
+        uint32_t slice = cycles - executed;
+        if (m_keyNext < m_keys.size()) slice = (uint32_t)std::min<uint64_t>(slice, m_keys[m_keyNext].cycle - m_cycles);
+
+        uint32_t ran;
+        switch (backend)
+        {
+            case backend_t::BlockCache: ran = RunBlocks(slice); break;
+            case backend_t::Jit:        ran = RunJit(slice); break;
+            case backend_t::Threaded:   ran = RunThreaded(slice); break;
+            case backend_t::Aot:        ran = RunAot(slice); break;
+            default:                    ran = RunInterpreter(slice, executed != 0); break;
+        }
+
+        executed += ran;
+        m_cycles += ran;
+    } while (executed < cycles && m_stop == stop_t::Budget);
+    ApplyKeys();
+
+    if (m_pendingRows != 0) PublishRows();
+
+    m_stops = 0;
+    return {m_stop, executed};
+}
+
+uint32_t
+Chip8::RunInterpreter(uint32_t cycles, bool isStarted)
+{
+    const bool isDebugging = (m_stops & GetStopMask(stop_t::Breakpoint)) && !m_breakpoints.empty();
+
+    uint32_t i = 0;
+    while (i < cycles)
+    {
+        // Not on the instruction the last stop left off at
+        if (isDebugging && (i != 0 || isStarted) && IsBreakpoint(m_c8.PC))
+        {
+            m_stop = stop_t::Breakpoint;
+            break;
+        }
+
+        Clock();
+        ++i;
+
+        if (m_stop != stop_t::Budget) break;
+    }
+    return i;
+}
+
+void
+Chip8::PublishRows()
+{
+    // One generation per Run() that changed the display
+    ++m_displayGeneration;
+    for (uint64_t rows = m_pendingRows; rows != 0; rows &= rows - 1)
+    {
+        m_rowGenerations[std::countr_zero(rows)] = m_displayGeneration;
+    }
+    m_pendingRows = 0;
+}
+
+uint32_t
+Chip8::RunBlocks(uint32_t budget)
+{
+    uint32_t cycles = budget;
+    while (cycles > 0)
+    {
+        const instruction_t* instrs = nullptr;
+        const CodeCache::decoded_t* block = m_cache->GetBlock(m_c8.PC, instrs);
+        if (block == nullptr)
+        {
+            // Not cacheable, let the interpreter deal with it
+            Clock();
+            --cycles;
+            if (m_stop != stop_t::Budget) break;
+            continue;
+        }
+
+        // Waiting on the delay timer or a key
+        if (block->idle)
+        {
+            uint32_t skipped = SkipIdle(cycles);
+            cycles -= skipped;
+            if (skipped != 0) continue;
+        }
+
+        // Blocks are straight-line code; only the last instruction may leave it
+        uint32_t count = std::min<uint32_t>(block->length, cycles);
+        uint32_t i = 0;
+        while (i < count)
+        {
+            const CodeCache::decoded_t &entry = block[i * 2];
+
+            // Superinstructions only run when the budget covers all of them
+            if (entry.fused != nullptr && entry.fusedLength <= cycles - i)
+            {
+                i += (this->*entry.fused)(&instrs[i], entry.fusedLength);
+            }
+            else
+            {
+                m_instr = instrs[i];
+                m_c8.PC += 2;
+
+                if (entry.function != nullptr)
+                {
+                    (this->*entry.function)();
+                }
+
+                UpdateTimers();
+                ++i;
+            }
+
+            if (m_stop != stop_t::Budget) break;
+        }
+
+        cycles -= i;
+        if (m_stop != stop_t::Budget) break;
+    }
+    return budget - cycles;
+}
+
+uint32_t
+Chip8::RunJit(uint32_t budget)
+{
+    uint32_t cycles = budget;
+    while (cycles > 0)
+    {
+        uint32_t executed = m_jit->Execute(m_c8, cycles);
+        if (executed == 0)
+        {
+            // Key and timer waits are never translated
+            uint32_t skipped = SkipIdle(cycles);
+            if (skipped != 0)
+            {
+                cycles -= skipped;
+                continue;
+            }
+
+            // Cold, untranslatable or out of budget for the whole block. Only these raise events
+            Clock();
+            --cycles;
+            if (m_stop != stop_t::Budget) break;
+            continue;
+        }
+
+        // Native code never touches the timers, so catching up afterwards is the same
+        UpdateTimers(executed);
+        cycles -= executed;
+    }
+    return budget - cycles;
+}
+
+// Every instruction, in the order the threaded backend labels them: first the ones it runs on the
+// registers it keeps in locals, then the ones it calls the handler of.
+// The second argument picks the quirk policy instantiation, if any
+#define THREADED_LOCAL_INSTRUCTIONS(X) \
+    X(00EE,) X(1NNN,) X(2NNN,) X(3XNN, <Q>) X(4XNN, <Q>) X(5XY0, <Q>) X(6XNN,) X(7XNN,) \
+    X(8XY0,) X(8XY1, <Q>) X(8XY2, <Q>) X(8XY3, <Q>) X(8XY4,) X(8XY5,) X(8XY6, <Q>) X(8XY7,) X(8XYE, <Q>) \
+    X(9XY0, <Q>) X(ANNN,) X(BNNN, <Q>) X(EX9E, <Q>) X(EXA1, <Q>) X(FX07,) X(FX15,) X(FX1E, <Q>) X(FX29,) X(FX65, <Q>)
+#define THREADED_MEMBER_INSTRUCTIONS(X) \
+    X(00E0,) X(CXNN,) X(DXYN, <Q>) X(FX0A,) X(FX18,) X(FX33,) X(FX55, <Q>) \
+    X(00CN,) X(00FB,) X(00FC,) X(00FD,) X(00FE,) X(00FF,) X(DXY0, <Q>) X(FX30,) X(FX75,) X(FX85,) \
+    X(00DN,) X(5XY2,) X(5XY3,) X(F000,) X(FN01,) X(F002,) X(FX3A,)
+#define THREADED_INSTRUCTIONS(X) THREADED_LOCAL_INSTRUCTIONS(X) THREADED_MEMBER_INSTRUCTIONS(X)
+
+uint32_t
+Chip8::RunThreaded(uint32_t cycles)
+{
+    switch (m_profile)
+    {
+        case profile_t::Chip8:     return RunThreaded<Chip8Quirks>(cycles);
+        case profile_t::SuperChip: return RunThreaded<SuperChipQuirks>(cycles);
+        case profile_t::XoChip:    return RunThreaded<XoChipQuirks>(cycles);
+        default:                   return RunThreaded<Chip0uQuirks>(cycles);
+    }
+}
+
+template <typename Q>
+uint32_t
+Chip8::RunThreaded(uint32_t budget)
+{
+    uint32_t cycles = budget;
+
+#if defined(__GNUC__) || defined(__clang__)
+    using c8 = Chip8;
+
+    // Handlers and their labels, index 0 being unknown opcodes
+    #define THREADED_HANDLER(op, q) &c8::OP_##op q,
+    #define THREADED_LABEL(op, q) &&L_##op,
+    static constexpr void (Chip8::*handlers[])(void) = { nullptr, THREADED_INSTRUCTIONS(THREADED_HANDLER) };
+    static void* const labels[] = { &&L_NONE, THREADED_INSTRUCTIONS(THREADED_LABEL) };
+    static_assert(std::size(handlers) == std::size(labels));
+
+    // Label index of every dispatch table entry
+    static const auto targets = [profile = m_profile]
+    {
+        std::array<uint8_t, std::tuple_size_v<dispatch_table_t>> targets{};
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            for (uint8_t h = 0; h < std::size(handlers); ++h)
+            {
+                if (s_dispatch[(size_t)profile][i].function == handlers[h]) targets[i] = h;
+            }
+        }
+        return targets;
+    }();
+
+    // The registers every instruction touches stay in locals for the whole run. They go back to
+    // m_c8 only around the handlers called, and when the run ends
+    uint16_t pc = m_c8.PC;
+    uint16_t I = m_c8.I;
+    uint8_t sp = m_c8.SP;
+    uint8_t* const V = m_c8.V;
+    uint16_t* const STACK = m_c8.STACK;
+    const uint8_t* const RAM = m_c8.RAM;
+    instruction_t instr(0);
+
+    #define THREADED_STORE() do { m_c8.PC = pc; m_c8.I = I; m_c8.SP = sp; } while (0)
+    #define THREADED_LOAD()  do { pc = m_c8.PC; I = m_c8.I; sp = m_c8.SP; } while (0)
+
+    // Fetch, decode and jump to the next handler. Each handler has its own copy of this
+    #define THREADED_NEXT()                                                                 \
+        do                                                                                  \
+        {                                                                                   \
+            if (cycles == 0)                                                                \
+            {                                                                               \
+                THREADED_STORE();                                                           \
+                return budget;                                                              \
+            }                                                                               \
+            --cycles;                                                                       \
+            instr = instruction_t(RAM[pc] << 8 | RAM[(pc + 1) % TOTAL_RAM]);                \
+            pc += 2;                                                                        \
+            goto *labels[targets[GetDispatchIndex(instr.OP)]];                              \
+        } while (0)
+
+    // End of an instruction run on the locals
+    #define THREADED_END() UpdateTimers(); THREADED_NEXT()
+
+    // SkipNext() on the locals
+    #define THREADED_SKIP()                                                                 \
+        do                                                                                  \
+        {                                                                                   \
+            if constexpr (Q::value.xo_chip)                                                 \
+            {                                                                               \
+                if (RAM[pc] == 0xF0 && RAM[(pc + 1) % TOTAL_RAM] == 0x00) pc += 2;          \
+            }                                                                               \
+            pc += 2;                                                                        \
+        } while (0)
+
+    // Everything else calls its handler on m_c8. Events only come from a few of them
+    #define THREADED_MEMBER(op, q)                                                          \
+        L_##op:                                                                             \
+        m_instr = instr;                                                                    \
+        THREADED_STORE();                                                                   \
+        OP_##op q();                                                                        \
+        UpdateTimers();                                                                     \
+        if constexpr (CanStop<Q>(&c8::OP_##op q))                                           \
+        {                                                                                   \
+            if (m_stop != stop_t::Budget) return budget - cycles;                           \
+        }                                                                                   \
+        if constexpr (&c8::OP_##op q == &c8::OP_FX0A)                                       \
+        {                                                                                   \
+            cycles -= SkipIdle(cycles);                                                     \
+        }                                                                                   \
+        THREADED_LOAD();                                                                    \
+        THREADED_NEXT();
+
+    THREADED_NEXT();
+
+L_NONE:
+    THREADED_END();
+
+    // The same as the handlers, on the locals
+L_00EE:
+    sp = (sp - 1) & (STACK_SIZE - 1);
+    pc = STACK[sp];
+    THREADED_END();
+L_1NNN:
+    pc = instr.NNN;
+    UpdateTimers();
+
+    // Jumps may land on an idle loop, which always starts with an FX instruction
+    if (RAM[pc] >> 4 == 0xF)
+    {
+        m_c8.PC = pc;
+        cycles -= SkipIdle(cycles);
+    }
+    THREADED_NEXT();
+L_2NNN:
+    STACK[sp] = pc;
+    sp = (sp + 1) & (STACK_SIZE - 1);
+    pc = instr.NNN;
+    THREADED_END();
+L_3XNN:
+    if (V[instr.X] == instr.NN) THREADED_SKIP();
+    THREADED_END();
+L_4XNN:
+    if (V[instr.X] != instr.NN) THREADED_SKIP();
+    THREADED_END();
+L_5XY0:
+    if (V[instr.X] == V[instr.Y]) THREADED_SKIP();
+    THREADED_END();
+L_6XNN:
+    V[instr.X] = instr.NN;
+    THREADED_END();
+L_7XNN:
+    V[instr.X] += instr.NN;
+    THREADED_END();
+L_8XY0:
+    V[instr.X] = V[instr.Y];
+    THREADED_END();
+L_8XY1:
+    V[instr.X] |= V[instr.Y];
+    if constexpr (Q::value.logic_resets_vf) V[0xF] = 0;
+    THREADED_END();
+L_8XY2:
+    V[instr.X] &= V[instr.Y];
+    if constexpr (Q::value.logic_resets_vf) V[0xF] = 0;
+    THREADED_END();
+L_8XY3:
+    V[instr.X] ^= V[instr.Y];
+    if constexpr (Q::value.logic_resets_vf) V[0xF] = 0;
+    THREADED_END();
+L_8XY4:
+    // VF is written first, so it is the one added when it is Vy
+    V[0xF] = V[instr.Y] > 0xFF - V[instr.X];
+    V[instr.X] += V[instr.Y];
+    THREADED_END();
+L_8XY5:
+    V[0xF] = V[instr.Y] <= V[instr.X];
+    V[instr.X] -= V[instr.Y];
+    THREADED_END();
+L_8XY6:
+    if constexpr (Q::value.shift_uses_vy) V[instr.X] = V[instr.Y];
+    V[0xF] = V[instr.X] & 0x1;
+    V[instr.X] >>= 1;
+    THREADED_END();
+L_8XY7:
+    V[0xF] = V[instr.X] <= V[instr.Y];
+    V[instr.X] = V[instr.Y] - V[instr.X];
+    THREADED_END();
+L_8XYE:
+    if constexpr (Q::value.shift_uses_vy) V[instr.X] = V[instr.Y];
+    V[0xF] = V[instr.X] >> 7;
+    V[instr.X] <<= 1;
+    THREADED_END();
+L_9XY0:
+    if (V[instr.X] != V[instr.Y]) THREADED_SKIP();
+    THREADED_END();
+L_ANNN:
+    I = instr.NNN;
+    THREADED_END();
+L_BNNN:
+    pc = (instr.NNN + V[Q::value.jump_uses_vx ? instr.X : 0]) & PROG_END;
+    THREADED_END();
+L_EX9E:
+    if (m_c8.KP >> (V[instr.X] & 0xF) & 1) THREADED_SKIP();
+    THREADED_END();
+L_EXA1:
+    if (!(m_c8.KP >> (V[instr.X] & 0xF) & 1)) THREADED_SKIP();
+    THREADED_END();
+L_FX07:
+    V[instr.X] = m_c8.DT;
+    THREADED_END();
+L_FX15:
+    m_c8.DT = V[instr.X];
+    THREADED_END();
+L_FX1E:
+    if constexpr (Q::value.add_i_sets_vf) V[0xF] = I + V[instr.X] > 0xFFF;
+    I += V[instr.X];
+    THREADED_END();
+L_FX29:
+    I = V[instr.X] * 0x5;
+    THREADED_END();
+L_FX65:
+    for (int i = 0; i <= instr.X; ++i)
+    {
+        V[i] = RAM[(I + i) % TOTAL_RAM];
+    }
+    if constexpr (Q::value.memory_moves_i) I += instr.X + 1;
+    THREADED_END();
+
+    THREADED_MEMBER_INSTRUCTIONS(THREADED_MEMBER)
+
+    #undef THREADED_MEMBER
+    #undef THREADED_SKIP
+    #undef THREADED_END
+    #undef THREADED_NEXT
+    #undef THREADED_LOAD
+    #undef THREADED_STORE
+    #undef THREADED_LABEL
+    #undef THREADED_HANDLER
+#else
+    return RunInterpreter(cycles);
+#endif
+}
+
+uint32_t
+Chip8::RunAot(uint32_t budget)
+{
+    // Modules only follow the quirks they were translated with
+    bool isUsable = m_aot->GetProfile() == m_profile;
+
+    uint32_t cycles = budget;
+    while (cycles > 0)
+    {
+        uint32_t executed = isUsable ? m_aot->Execute(m_c8, cycles) : 0;
+        if (executed == 0)
         {
-            (this->*it->second.function)();
+            // Not translated, overwritten since or out of budget for the whole block
+            uint32_t skipped = SkipIdle(cycles);
+            if (skipped != 0)
+            {
+                cycles -= skipped;
+                continue;
+            }
+
+            Clock();
+            --cycles;
+            if (m_stop != stop_t::Budget) break;
+            continue;
         }
+
+        // Blocks never touch the timers, so catching up afterwards is the same
+        UpdateTimers(executed);
+        cycles -= executed;
+    }
+    return budget - cycles;
+}
+
+bool
+Chip8::IsBackendAvailable(backend_t backend) const
+{
+    switch (backend)
+    {
+        case backend_t::Jit: return m_jit->IsAvailable();
+        case backend_t::Aot: return m_aot->IsLoaded() && m_aot->GetProfile() == m_profile;
+        default:             return backend < backend_t::Count;
+    }
+}
+
+void
+Chip8::UpdateTimers(uint32_t cycles)
+{
+    m_timerPhase += (uint64_t)cycles * TIMER_RATE;
+    if (m_timerPhase < m_clockRate) return;
+
+    // Mostly a single tick, which needs no division
+    uint64_t ticks = 1;
+    m_timerPhase -= m_clockRate;
+    if (m_timerPhase >= m_clockRate)
+    {
+        ticks += m_timerPhase / m_clockRate;
+        m_timerPhase %= m_clockRate;
     }
 
-    // Update timers
-    if (m_c8.DT > 0) --m_c8.DT;
+    m_c8.DT = m_c8.DT > ticks ? m_c8.DT - ticks : 0;
     if (m_c8.ST > 0)
     {
-        if (m_c8.ST == 1) printf("BEEP!\n");
-        --m_c8.ST;
+        if (m_c8.ST <= ticks && !m_isSpeculative) printf("BEEP!\n");
+        m_c8.ST = m_c8.ST > ticks ? m_c8.ST - ticks : 0;
     }
 }
 
+uint8_t
+Chip8::GetDelayTimerAfter(uint32_t cycles) const
+{
+    const uint64_t ticks = (m_timerPhase + (uint64_t)cycles * TIMER_RATE) / m_clockRate;
+    return m_c8.DT > ticks ? m_c8.DT - ticks : 0;
+}
+
+void
+Chip8::SetClockRate(uint32_t rate)
+{
+    rate = std::max(1u, rate);
+
+    // Just as far into the current tick
+    m_timerPhase = m_timerPhase * rate / m_clockRate;
+    m_clockRate = rate;
+}
+
+Chip8::run_t
+Chip8::RunFor(double seconds, uint32_t stops)
+{
+    m_cycleCredit += seconds * m_clockRate;
+
+    const uint32_t cycles = (uint32_t)std::min(m_cycleCredit, (double)UINT32_MAX);
+    m_cycleCredit -= cycles;
+
+    run_t result = Run(cycles, stops);
+    m_cycleCredit += cycles - result.cycles;
+    return result;
+}
+
+void
+Chip8::QueueKey(uint64_t cycle, uint8_t key, bool state)
+{
+    cuAssert(key < 16 && "Invalid key");
+
+    // Nothing to wait for
+    const bool isPending = m_keyNext < m_keys.size();
+    if (cycle <= m_cycles && !isPending)
+    {
+        SetKey(key, state);
+        return;
+    }
+
+    // Never before a key queued earlier
+    if (isPending) cycle = std::max(cycle, m_keys.back().cycle);
+    m_keys.push_back({std::max(cycle, m_cycles), key, state});
+}
+
+void
+Chip8::ApplyKeys()
+{
+    while (m_keyNext < m_keys.size() && m_keys[m_keyNext].cycle <= m_cycles)
+    {
+        SetKey(m_keys[m_keyNext].key, m_keys[m_keyNext].state);
+        ++m_keyNext;
+    }
+
+    if (m_keyNext != 0 && m_keyNext == m_keys.size())
+    {
+        m_keys.clear();
+        m_keyNext = 0;
+    }
+}
+
+void
+Chip8::AddBreakpoint(uint16_t PC)
+{
+    if (!IsBreakpoint(PC)) m_breakpoints.push_back({PC});
+}
+
+void
+Chip8::RemoveBreakpoint(uint16_t PC)
+{
+    std::erase_if(m_breakpoints, [PC](const debug_t &breakpoint) { return breakpoint.PC == PC; });
+}
+
+bool
+Chip8::IsBreakpoint(uint16_t PC) const
+{
+    return std::any_of(m_breakpoints.begin(), m_breakpoints.end(), [PC](const debug_t &breakpoint) { return breakpoint.PC == PC; });
+}
+
+float
+Chip8::GetAudioRate() const
+{
+    // 4000Hz at the default pitch of 64, an octave every 48 steps
+    return 4000.0f * std::exp2((m_c8.PITCH - 64) / 48.0f);
+}
+
+uint32_t
+Chip8::SkipIdle(uint32_t cycles)
+{
+    uint16_t pc = m_c8.PC;
+    if (pc >= TOTAL_RAM - 5) return 0;
+
+    auto fetch = [this](uint16_t addr) { return instruction_t(m_c8.RAM[addr] << 8 | m_c8.RAM[addr + 1]); };
+    instruction_t wait = fetch(pc);
+
+    // FX0A with no key down spins for the whole budget, keys only change between slices of a run.
+    // Unless the caller wants to know, when it runs once and stops
+    if ((wait.OP & 0xF0FF) == 0xF00A)
+    {
+        if (m_stops & GetStopMask(stop_t::KeyWait) || m_c8.KP != 0) return 0;
+
+        m_instr = wait;
+        UpdateTimers(cycles);
+        return cycles;
+    }
+
+    // FX07, 3XNN, 1NNN back to the FX07: polls the delay timer, 3 instructions a round
+    instruction_t skip = fetch(pc + 2);
+    instruction_t jump = fetch(pc + 4);
+    if ((wait.OP & 0xF0FF) != 0xF007 || (skip.OP & 0xF000) != 0x3000 || jump.OP != (0x1000 | pc)) return 0;
+
+    // Round in which the comparison succeeds; round r reads GetDelayTimerAfter(3r). The first round
+    // the timer has ticked `ticks` times by starts after (ticks * m_clockRate - m_timerPhase) / TIMER_RATE
+    // instructions
+    constexpr uint32_t NEVER = UINT32_MAX;
+    auto roundAfter = [this](uint64_t ticks) -> uint64_t
+    {
+        const uint64_t phase = ticks * m_clockRate;
+        return phase > m_timerPhase ? (phase - m_timerPhase + 3 * TIMER_RATE - 1) / (3 * TIMER_RATE) : 0;
+    };
+
+    uint32_t dt = m_c8.DT;
+    uint32_t exit = NEVER;
+    if (skip.X != wait.X)       exit = (m_c8.V[skip.X] == skip.NN) ? 0 : NEVER;
+    else if (skip.NN == 0)      exit = (uint32_t)std::min<uint64_t>(roundAfter(dt), NEVER);
+    else if (dt >= skip.NN)
+    {
+        // A round that spans more than a tick can step over the value. Past the budget it doesn't matter
+        const uint64_t round = std::min<uint64_t>(roundAfter(dt - skip.NN), cycles / 3 + 1);
+        if (round > cycles / 3 || GetDelayTimerAfter(3 * round) == skip.NN) exit = (uint32_t)round;
+    }
+
+    // Only skip whole rounds that loop back
+    uint32_t rounds = std::min(cycles / 3, exit);
+    if (rounds == 0) return 0;
+
+    m_c8.V[wait.X] = GetDelayTimerAfter(3 * (rounds - 1));
+    m_instr = jump;
+    UpdateTimers(rounds * 3);
+
+    return rounds * 3;
+}
+
+void
+Chip8::InvalidateCode(uint16_t addr, uint16_t size)
+{
+    m_cache->Invalidate(addr, size);
+    m_jit->Invalidate(addr, size);
+    m_aot->Invalidate(addr, size);
+
+    // What RestoreSnapshot() copies back; writes wrapping around the end take all of it
+    const bool isWrapped = addr + size > TOTAL_RAM;
+    m_writtenStart = std::min<uint32_t>(m_writtenStart, isWrapped ? 0 : addr);
+    m_writtenEnd = std::max<uint32_t>(m_writtenEnd, isWrapped ? TOTAL_RAM : addr + size);
+}
+
+void
+Chip8::CopyState(chip8_t &to, const chip8_t &from, uint32_t start, uint32_t end)
+{
+    constexpr size_t ramStart = offsetof(chip8_t, RAM), ramEnd = ramStart + sizeof(from.RAM);
+    memcpy(&to, &from, ramStart);
+    memcpy((uint8_t*)&to + ramEnd, (const uint8_t*)&from + ramEnd, sizeof(chip8_t) - ramEnd);
+    if (start < end) memcpy(to.RAM + start, from.RAM + start, end - start);
+}
+
+void
+Chip8::SaveSnapshot(snapshot_t &snapshot)
+{
+    // Over the last one saved, memory only differs where it was written since
+    if (snapshot.serial == m_snapshotSerial) CopyState(snapshot.state, m_c8, m_writtenStart, m_writtenEnd);
+    else snapshot.state = m_c8;
+    snapshot.cycles = m_cycles;
+    snapshot.keys.assign(m_keys.begin() + m_keyNext, m_keys.end());
+    snapshot.timerPhase = m_timerPhase;
+    snapshot.cycleCredit = m_cycleCredit;
+    snapshot.rng = m_rng;
+    snapshot.drawnRows = m_drawnRows;
+    snapshot.drawnPlanes = m_drawnPlanes;
+    snapshot.displayGeneration = m_displayGeneration;
+    snapshot.serial = ++m_snapshotSerial;
+
+    m_writtenStart = TOTAL_RAM;
+    m_writtenEnd = 0;
+}
+
+void
+Chip8::RestoreSnapshot(const snapshot_t &snapshot)
+{
+    if (snapshot.serial == m_snapshotSerial)
+    {
+        CopyState(m_c8, snapshot.state, m_writtenStart, m_writtenEnd);
+        if (m_writtenStart < std::min<uint32_t>(m_writtenEnd, CODE_SIZE))
+        {
+            InvalidateCode(m_writtenStart, std::min<uint32_t>(m_writtenEnd, CODE_SIZE) - m_writtenStart);
+        }
+    }
+    else
+    {
+        m_c8 = snapshot.state;
+        InvalidateCode(0, CODE_SIZE);
+        m_aot->Validate(m_c8.RAM);
+
+        // Memory is nothing like the last snapshot's now
+        ++m_snapshotSerial;
+    }
+
+    m_cycles = snapshot.cycles;
+    m_keys = snapshot.keys;
+    m_keyNext = 0;
+    m_timerPhase = snapshot.timerPhase;
+    m_cycleCredit = snapshot.cycleCredit;
+    m_rng = snapshot.rng;
+    m_drawnRows = snapshot.drawnRows;
+    m_drawnPlanes = snapshot.drawnPlanes;
+
+    // Memory matches the snapshot again
+    m_writtenStart = TOTAL_RAM;
+    m_writtenEnd = 0;
+
+    // Rows changed since are changed back: a new generation for them, never an old one
+    for (uint32_t y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        if (m_rowGenerations[y] > snapshot.displayGeneration) m_pendingRows |= 1ull << y;
+    }
+    if (m_pendingRows != 0) PublishRows();
+}
+
+uint32_t
+Chip8::GetFusionCount(fusion_t fusion) const
+{
+    return m_cache->GetFusionCount(fusion);
+}
+
+uint32_t
+Chip8::GetCodeShareCount() const
+{
+    return m_cache->GetShareCount();
+}
+
+void
+Chip8::SetProfile(profile_t profile)
+{
+    cuAssert(profile < profile_t::Count && "Invalid profile");
+
+    // Swap the handlers; anything decoded with the old ones is stale
+    m_profile  = profile;
+    m_dispatch = &s_dispatch[(size_t)profile];
+    m_cache->SetProfile(profile);
+    m_jit->SetProfile(profile);
+}
+
 void
 Chip8::Reset()
 {
@@ -197,19 +1028,45 @@ Chip8::Reset()
     // Clear memory
     memset(m_c8.RAM, 0, sizeof(m_c8.RAM));
 
-    // Clear keypad memory
-    memset(m_c8.KP, 0, sizeof(m_c8.KP));
+    // No keys down, or coming
+    m_c8.KP = 0;
+    m_cycles = 0;
+    m_keys.clear();
+    m_keyNext = 0;
 
     // Load fontset into memory (0x000 - 0x1FF)
     {
         for (int i = 0; i < 16 * 5; ++i) m_c8.RAM[i] = FONT_SET[i];
+        for (int i = 0; i < BIG_FONT_SIZE; ++i) m_c8.RAM[FONT_SET_SIZE + i] = BIG_FONT_SET[i];
     }
 
-    // Reset timers
-    m_c8.DT = 0; m_c8.ST = 0;
+    // 64x32 display, no flags saved
+    m_c8.HIRES = 0;
+    memset(m_c8.RPL, 0, sizeof(m_c8.RPL));
+
+    // First plane selected, silent pattern at 4000Hz
+    m_c8.PLANES = 1;
+    m_c8.PITCH = 64;
+    memset(m_c8.AUDIO, 0, sizeof(m_c8.AUDIO));
 
-    // Clear display
-    m_c8.DF = true;
+    // Reset timers, at the start of a tick
+    m_c8.DT = 0; m_c8.ST = 0;
+    m_timerPhase = 0;
+    m_cycleCredit = 0.0;
+
+    // Every row changed, whatever was on them
+    m_pendingRows = ~0ull;
+    m_drawnRows = 0;
+    m_drawnPlanes = 0;
+    PublishRows();
+
+    // Snapshots from before are of another run
+    ++m_snapshotSerial;
+
+    // Memory is gone, and so is the code decoded from it
+    m_cache->Clear();
+    m_jit->Clear();
+    m_aot->Validate(m_c8.RAM);
 }
 
 // Instructions
@@ -218,16 +1075,23 @@ Chip8::Reset()
 void
 Chip8::OP_00E0()
 {
-    // Clear the display
-    memset(m_c8.DP, 0, sizeof(m_c8.DP));
-    m_c8.DF = true;
+    // Clear the selected planes; only rows drawn to since the last clear change
+    for (uint32_t plane = 0; plane < PLANE_COUNT; ++plane)
+    {
+        if (m_c8.PLANES >> plane & 1) memset(m_c8.DP[plane], 0, sizeof(m_c8.DP[plane]));
+    }
+    m_pendingRows |= m_drawnRows;
+    Raise(stop_t::Draw);
+
+    m_drawnPlanes &= ~m_c8.PLANES;
+    if (m_drawnPlanes == 0) m_drawnRows = 0;
 }
 
 void
 Chip8::OP_00EE()
 {
-    // Return from a subroutine
-    --m_c8.SP;
+    // Return from a subroutine; the stack wraps around rather than running into the keypad and display
+    m_c8.SP = (m_c8.SP - 1) & (STACK_SIZE - 1);
     m_c8.PC = m_c8.STACK[m_c8.SP];
 }
 
@@ -243,37 +1107,40 @@ Chip8::OP_2NNN()
 {
     // Call subroutine at NNN
     m_c8.STACK[m_c8.SP] = m_c8.PC;
-    ++m_c8.SP;
+    m_c8.SP = (m_c8.SP + 1) & (STACK_SIZE - 1);
     m_c8.PC = m_instr.NNN;
 }
 
+template <typename Q>
 void
 Chip8::OP_3XNN()
 {
     // Skip next instruction if Vx == NN
     if (m_c8.V[m_instr.X] == m_instr.NN)
     {
-        m_c8.PC += 2;
+        SkipNext<Q>();
     }
 }
 
+template <typename Q>
 void
 Chip8::OP_4XNN()
 {
     // Skip next instruction if Vx != NN
     if (m_c8.V[m_instr.X] != m_instr.NN)
     {
-        m_c8.PC += 2;
+        SkipNext<Q>();
     }
 }
 
+template <typename Q>
 void
 Chip8::OP_5XY0()
 {
     // Skip next instruction if Vx == Vy
-    if (m_c8.V[m_instr.X] == m_instr.NN)
+    if (m_c8.V[m_instr.X] == m_c8.V[m_instr.Y])
     {
-        m_c8.PC += 2;
+        SkipNext<Q>();
     }
 }
 
@@ -298,25 +1165,37 @@ Chip8::OP_8XY0()
     m_c8.V[m_instr.X] = m_c8.V[m_instr.Y];
 }
 
+template <typename Q>
 void
 Chip8::OP_8XY1()
 {
     // Set Vx = Vx OR Vy
     m_c8.V[m_instr.X] |= m_c8.V[m_instr.Y];
+
+    // The COSMAC VIP ran logic ops through the ALU, leaving VF clobbered
+    if constexpr (Q::value.logic_resets_vf) m_c8.V[0xF] = 0;
 }
 
+template <typename Q>
 void
 Chip8::OP_8XY2()
 {
     // Set Vx = Vx AND Vy
     m_c8.V[m_instr.X] &= m_c8.V[m_instr.Y];
+
+    // The COSMAC VIP ran logic ops through the ALU, leaving VF clobbered
+    if constexpr (Q::value.logic_resets_vf) m_c8.V[0xF] = 0;
 }
 
+template <typename Q>
 void
 Chip8::OP_8XY3()
 {
     // Set Vx = Vx XOR Vy
     m_c8.V[m_instr.X] ^= m_c8.V[m_instr.Y];
+
+    // The COSMAC VIP ran logic ops through the ALU, leaving VF clobbered
+    if constexpr (Q::value.logic_resets_vf) m_c8.V[0xF] = 0;
 }
 
 void
@@ -351,10 +1230,13 @@ Chip8::OP_8XY5()
     m_c8.V[m_instr.X] -= m_c8.V[m_instr.Y];
 }
 
+template <typename Q>
 void
 Chip8::OP_8XY6()
 {
-    // Set Vx = Vx SHR 1
+    // Set Vx = Vx SHR 1; originally Vx = Vy SHR 1
+    if constexpr (Q::value.shift_uses_vy) m_c8.V[m_instr.X] = m_c8.V[m_instr.Y];
+
     m_c8.V[0xF] = m_c8.V[m_instr.X] & 0x1;
     m_c8.V[m_instr.X] >>= 1;
 }
@@ -375,21 +1257,25 @@ Chip8::OP_8XY7()
     m_c8.V[m_instr.X] = m_c8.V[m_instr.Y] - m_c8.V[m_instr.X];
 }
 
+template <typename Q>
 void
 Chip8::OP_8XYE()
 {
-    // Set Vx = Vx SHL 1
+    // Set Vx = Vx SHL 1; originally Vx = Vy SHL 1
+    if constexpr (Q::value.shift_uses_vy) m_c8.V[m_instr.X] = m_c8.V[m_instr.Y];
+
     m_c8.V[0xF] = m_c8.V[m_instr.X] >> 7;
     m_c8.V[m_instr.X] <<= 1;
 }
 
+template <typename Q>
 void
 Chip8::OP_9XY0()
 {
     // Skip next instruction if Vx != Vy
     if (m_c8.V[m_instr.X] != m_c8.V[m_instr.Y])
     {
-        m_c8.PC += 2;
+        SkipNext<Q>();
     }
 }
 
@@ -400,76 +1286,158 @@ Chip8::OP_ANNN()
     m_c8.I = m_instr.NNN;
 }
 
+template <typename Q>
 void
 Chip8::OP_BNNN()
 {
-    // Jump to location NNN + V0
-    m_c8.PC = m_instr.NNN + m_c8.V[0];
+    // Jump to location NNN + V0; NNN + Vx on SUPER-CHIP. Addresses are 12 bits wide
+    if constexpr (Q::value.jump_uses_vx)
+    {
+        m_c8.PC = (m_instr.NNN + m_c8.V[m_instr.X]) & PROG_END;
+    }
+    else
+    {
+        m_c8.PC = (m_instr.NNN + m_c8.V[0]) & PROG_END;
+    }
 }
 
 void
 Chip8::OP_CXNN()
 {
     // Set Vx = random byte AND NN
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    gen.seed(std::chrono::system_clock::now().time_since_epoch().count());
     std::uniform_int_distribution<> distrib(0, 0xFF);
 
-    m_c8.V[m_instr.X] = distrib(gen) & m_instr.NN;
+    m_c8.V[m_instr.X] = distrib(m_rng) & m_instr.NN;
 }
 
+template <typename Q>
 void
 Chip8::OP_DXYN()
 {
     // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision
-    uint8_t spriteX = m_c8.V[m_instr.X];
-    uint8_t spriteY = m_c8.V[m_instr.Y];
-    uint8_t spriteHeight = m_instr.N;
-    uint8_t pixel;
+    DrawSprite<Q, false>(m_instr.N);
+}
+
+template <typename Q, bool isWide>
+void
+Chip8::DrawSprite(uint32_t height)
+{
+    // The sprite starts wrapped into the screen, and is clipped at its edges or wrapped around them
+    // depending on the quirks; both sizes are powers of two
+    constexpr bool isWrapping = Q::value.wrap_sprites;
+    const uint32_t displayHeight = GetDisplayHeight();
+    const uint32_t spriteX = m_c8.V[m_instr.X] & (GetDisplayWidth() - 1);
+    const uint32_t spriteY = m_c8.V[m_instr.Y] & (displayHeight - 1);
+    const uint32_t spriteHeight = isWrapping ? height : std::min(height, displayHeight - spriteY);
+    const uint32_t lineMask = isWrapping ? displayHeight - 1 : UINT32_MAX;
+
+    // Words of the row the sprite starts in, and the one after it on the 128x64 display. Wrapping,
+    // the one after the last is the first, which on the 64x32 display is the same one
+    const uint32_t words = GetDisplayWidth() / 64;
+    const uint32_t word = spriteX / 64, shift = spriteX % 64;
+    const uint32_t next = isWrapping ? (word + 1) & (words - 1) : word + 1;
+    const bool isSplit = shift != 0 && (isWrapping || next < words);
+
+    // XO-CHIP draws a sprite per selected plane, the second one `height` lines after the first
+    const uint32_t planes = m_c8.PLANES;
+    if (planes == 0)
+    {
+        m_c8.V[0xF] = 0;
+        return;
+    }
+    const uint32_t plane = planes == 2 ? 1 : 0;
 
-    m_c8.V[0xF] = 0; // Reset collision flag
-    for (int currentLine = 0; currentLine < spriteHeight; currentLine++)
+    auto sprite = [this](uint32_t line)
     {
-        pixel = m_c8.RAM[m_c8.I + currentLine];
-        for (int currentPixel = 0; currentPixel < 8; currentPixel++)
+        if constexpr (isWide) return (uint64_t)(m_c8.RAM[(m_c8.I + line * 2) % TOTAL_RAM] << 8 | m_c8.RAM[(m_c8.I + line * 2 + 1) % TOTAL_RAM]) << 48;
+        else return (uint64_t)m_c8.RAM[(m_c8.I + line) % TOTAL_RAM] << 56;
+    };
+
+    // Each sprite row is placed in whole display words at once; pixels past the right edge shift out.
+    // The part spilling into the next word goes in a second pass, which the 64x32 display never takes.
+    // Both planes are drawn in the same passes, so they cost about as much as one
+    auto blit = [&](auto isBoth)
+    {
+        uint64_t collision = 0;
+        for (uint32_t currentLine = 0; currentLine < spriteHeight; currentLine++)
         {
-            // Determine if the current pixel will flip
-            if ((pixel & (0x80 >> currentPixel)) != 0)
-            {
-                int displayIndex = (spriteX + currentPixel) + ((spriteY + currentLine) * 64);
-                if (m_c8.DP[displayIndex] == 1)
-                {
-                    m_c8.V[0xF] = 1; // Set collision flag
-                }
-                m_c8.DP[displayIndex] ^= 1; // Flip the pixel at the displayIndex
-            }
+            const uint32_t y = (spriteY + currentLine) & lineMask;
+            uint64_t &row = m_c8.DP[plane][y][word];
+            collision |= row & (sprite(currentLine) >> shift);
+            row ^= sprite(currentLine) >> shift;
+
+            if constexpr (!isBoth) continue;
+            uint64_t &row2 = m_c8.DP[1][y][word];
+            collision |= row2 & (sprite(height + currentLine) >> shift);
+            row2 ^= sprite(height + currentLine) >> shift;
         }
-    }
 
-    m_c8.DF = true;
+        for (uint32_t currentLine = 0; isSplit && currentLine < spriteHeight; currentLine++)
+        {
+            const uint32_t y = (spriteY + currentLine) & lineMask;
+            uint64_t &row = m_c8.DP[plane][y][next];
+            collision |= row & (sprite(currentLine) << (64 - shift));
+            row ^= sprite(currentLine) << (64 - shift);
+
+            if constexpr (!isBoth) continue;
+            uint64_t &row2 = m_c8.DP[1][y][next];
+            collision |= row2 & (sprite(height + currentLine) << (64 - shift));
+            row2 ^= sprite(height + currentLine) << (64 - shift);
+        }
+        return collision;
+    };
+    const uint64_t collision = planes == 3 ? blit(std::true_type{}) : blit(std::false_type{});
+
+    m_c8.V[0xF] = collision != 0;
+
+    // Rows under the sprite, the ones past the bottom at the top when wrapping
+    uint64_t rows = ((1ull << spriteHeight) - 1) << spriteY;
+    if constexpr (isWrapping)
+    {
+        if (spriteY + spriteHeight > displayHeight) rows |= (1ull << (spriteY + spriteHeight - displayHeight)) - 1;
+        if (displayHeight < 64) rows &= (1ull << displayHeight) - 1;
+    }
+    m_pendingRows |= rows;
+    m_drawnRows |= rows;
+    m_drawnPlanes |= planes;
+    Raise(stop_t::Draw);
 }
 
+template <typename Q>
 void
 Chip8::OP_EX9E()
 {
     // Skip next instruction if key with the value of Vx is pressed
-    uint8_t key = m_c8.V[m_instr.X];
-    if (m_c8.KP[key] != 0)
+    uint8_t key = m_c8.V[m_instr.X] & 0xF;
+    if (m_c8.KP >> key & 1)
     {
-        m_c8.PC += 2;
+        SkipNext<Q>();
     }
 }
 
+template <typename Q>
 void
 Chip8::OP_EXA1()
 {
     // Skip next instruction if key with the value of Vx is not pressed
-    uint8_t key = m_c8.V[m_instr.X];
-    if (m_c8.KP[key] == 0)
+    uint8_t key = m_c8.V[m_instr.X] & 0xF;
+    if (!(m_c8.KP >> key & 1))
+    {
+        SkipNext<Q>();
+    }
+}
+
+template <typename Q>
+void
+Chip8::SkipNext()
+{
+    // XO-CHIP steps over both words of F000 NNNN
+    if constexpr (Q::value.xo_chip)
     {
-        m_c8.PC += 2;
+        if (m_c8.RAM[m_c8.PC] == 0xF0 && m_c8.RAM[(m_c8.PC + 1) % TOTAL_RAM] == 0x00) m_c8.PC += 2;
     }
+
+    m_c8.PC += 2;
 }
 
 void
@@ -482,21 +1450,16 @@ Chip8::OP_FX07()
 void
 Chip8::OP_FX0A()
 {
-    // Wait for a key press, store the value of the key in Vx
-    bool keyPress = false;
-    for (int i = 0; i < 16; ++i)
+    // Wait for a key press, store the value of the key in Vx, the highest one if several are down
+    if (m_c8.KP != 0)
     {
-        if (m_c8.KP[i] != 0)
-        {
-            m_c8.V[m_instr.X] = i;
-            keyPress = true;
-        }
+        m_c8.V[m_instr.X] = std::bit_width(m_c8.KP) - 1;
     }
-
     // If no key is pressed, return and try again
-    if (!keyPress)
+    else
     {
         m_c8.PC -= 2;
+        Raise(stop_t::KeyWait);
     }
 }
 
@@ -511,20 +1474,18 @@ void
 Chip8::OP_FX18()
 {
     // Set sound timer = Vx
+    if (m_c8.ST == 0 && m_c8.V[m_instr.X] != 0) Raise(stop_t::Sound);
     m_c8.ST = m_c8.V[m_instr.X];
 }
 
+template <typename Q>
 void
 Chip8::OP_FX1E()
 {
-    // Set I = I + Vx
-    if (m_c8.I + m_c8.V[m_instr.X] > 0xFFF)
+    // Set I = I + Vx, and VF = overflow on the Amiga interpreter
+    if constexpr (Q::value.add_i_sets_vf)
     {
-        m_c8.V[0xF] = 1;
-    }
-    else
-    {
-        m_c8.V[0xF] = 0;
+        m_c8.V[0xF] = (m_c8.I + m_c8.V[m_instr.X] > 0xFFF) ? 1 : 0;
     }
 
     m_c8.I += m_c8.V[m_instr.X];
@@ -542,57 +1503,333 @@ Chip8::OP_FX33()
 {
     // Store BCD representation of Vx in memory locations I, I+1, and I+2
     uint8_t Vx = m_c8.V[m_instr.X];
-    m_c8.RAM[m_c8.I + 0] = Vx / 100;
-    m_c8.RAM[m_c8.I + 1] = (Vx / 10) % 10;
-    m_c8.RAM[m_c8.I + 2] = (Vx % 100) % 10;
+    m_c8.RAM[(m_c8.I + 0) % TOTAL_RAM] = Vx / 100;
+    m_c8.RAM[(m_c8.I + 1) % TOTAL_RAM] = (Vx / 10) % 10;
+    m_c8.RAM[(m_c8.I + 2) % TOTAL_RAM] = (Vx % 100) % 10;
+
+    // Self-modifying code
+    InvalidateCode(m_c8.I, 3);
 }
 
+template <typename Q>
 void
 Chip8::OP_FX55()
 {
     // Store registers V0 through Vx in memory starting at location I
     for (int i = 0; i <= m_instr.X; ++i)
     {
-        m_c8.RAM[m_c8.I + i] = m_c8.V[i];
+        m_c8.RAM[(m_c8.I + i) % TOTAL_RAM] = m_c8.V[i];
     }
 
+    // Self-modifying code
+    InvalidateCode(m_c8.I, m_instr.X + 1);
+
     // On the original interpreter, when the operation is done, I = I + X + 1
-    m_c8.I += m_instr.X + 1;
+    if constexpr (Q::value.memory_moves_i) m_c8.I += m_instr.X + 1;
 }
 
+template <typename Q>
 void
 Chip8::OP_FX65()
 {
     // Read registers V0 through Vx from memory starting at location I
     for (int i = 0; i <= m_instr.X; ++i)
     {
-        m_c8.V[i] = m_c8.RAM[m_c8.I + i];
+        m_c8.V[i] = m_c8.RAM[(m_c8.I + i) % TOTAL_RAM];
     }
 
     // On the original interpreter, when the operation is done, I = I + X + 1
-    m_c8.I += m_instr.X + 1;
+    if constexpr (Q::value.memory_moves_i) m_c8.I += m_instr.X + 1;
 }
 
-// --------------------------------------------------------------------------------
+void
+Chip8::OP_00CN()
+{
+    // Scroll the display down N rows
+    ScrollVertical(m_instr.N);
+}
 
-uint16_t
-Chip8::GetMaskedOpcode(uint16_t opcode)
+void
+Chip8::ScrollVertical(int32_t rows)
 {
-    uint16_t masked_opcode = opcode & 0xF000;
+    // A row at a time, in the selected planes
+    const uint32_t height = GetDisplayHeight(), n = std::min<uint32_t>(std::abs(rows), height);
+    for (uint32_t plane = 0; plane < PLANE_COUNT; ++plane)
+    {
+        if ((m_c8.PLANES >> plane & 1) == 0) continue;
 
-    switch (masked_opcode >> 12)
+        auto &dp = m_c8.DP[plane];
+        if (rows > 0)
+        {
+            memmove(dp[n], dp[0], (height - n) * sizeof(dp[0]));
+            memset(dp[0], 0, n * sizeof(dp[0]));
+        }
+        else
+        {
+            memmove(dp[0], dp[n], (height - n) * sizeof(dp[0]));
+            memset(dp[height - n], 0, n * sizeof(dp[0]));
+        }
+    }
+
+    // Rows drawn to, where they were and where they went. Planes left in place keep theirs
+    const uint64_t moved = rows > 0 ? (m_drawnRows << n) & (~0ull >> (64 - height)) : m_drawnRows >> n;
+    m_pendingRows |= m_drawnRows | moved;
+    m_drawnRows = (m_drawnPlanes & ~m_c8.PLANES) != 0 ? m_drawnRows | moved : moved;
+    Raise(stop_t::Draw);
+}
+
+void
+Chip8::OP_00FB()
+{
+    // Scroll the selected planes right 4 pixels, a word at a time; the 64x32 display only has the first
+    for (uint32_t plane = 0; plane < PLANE_COUNT; ++plane)
     {
-        case 0x0: masked_opcode = (opcode & 0x00F0) | (opcode & 0x000F); break;
-        case 0x8: masked_opcode = opcode & 0xF00F; break;
+        if ((m_c8.PLANES >> plane & 1) == 0) continue;
 
-        case 0xE:
-        case 0xF: masked_opcode = opcode & 0xF0FF; break;
-        default: break;
+        if (m_c8.HIRES)
+        {
+            for (auto &row : m_c8.DP[plane])
+            {
+                row[1] = row[1] >> 4 | row[0] << 60;
+                row[0] >>= 4;
+            }
+        }
+        else
+        {
+            for (uint32_t y = 0; y < LORES_HEIGHT; ++y) m_c8.DP[plane][y][0] >>= 4;
+        }
     }
+    m_pendingRows |= m_drawnRows;
+    Raise(stop_t::Draw);
+}
 
-    return masked_opcode;
+void
+Chip8::OP_00FC()
+{
+    // Scroll the selected planes left 4 pixels
+    for (uint32_t plane = 0; plane < PLANE_COUNT; ++plane)
+    {
+        if ((m_c8.PLANES >> plane & 1) == 0) continue;
+
+        if (m_c8.HIRES)
+        {
+            for (auto &row : m_c8.DP[plane])
+            {
+                row[0] = row[0] << 4 | row[1] >> 60;
+                row[1] <<= 4;
+            }
+        }
+        else
+        {
+            for (uint32_t y = 0; y < LORES_HEIGHT; ++y) m_c8.DP[plane][y][0] <<= 4;
+        }
+    }
+    m_pendingRows |= m_drawnRows;
+    Raise(stop_t::Draw);
+}
+
+void
+Chip8::OP_00FD()
+{
+    // Exit: stay on this instruction from now on
+    m_c8.PC -= 2;
+}
+
+void
+Chip8::OP_00FE()
+{
+    SetHires(false);
+}
+
+void
+Chip8::OP_00FF()
+{
+    SetHires(true);
+}
+
+void
+Chip8::SetHires(bool isHires)
+{
+    // Both modes start from a clear display, every plane of it
+    m_c8.HIRES = isHires;
+    memset(m_c8.DP, 0, sizeof(m_c8.DP));
+    m_pendingRows = ~0ull;
+    m_drawnRows = 0;
+    m_drawnPlanes = 0;
+    Raise(stop_t::Draw);
+}
+
+template <typename Q>
+void
+Chip8::OP_DXY0()
+{
+    // Display a 16x16 sprite from I at (Vx, Vy), set VF = collision
+    DrawSprite<Q, true>(16);
+}
+
+void
+Chip8::OP_FX30()
+{
+    // Set I = location of the big sprite for digit Vx
+    m_c8.I = FONT_SET_SIZE + (m_c8.V[m_instr.X] & 0xF) * 10;
+}
+
+void
+Chip8::OP_FX75()
+{
+    // Save V0 to Vx in the flag registers
+    memcpy(m_c8.RPL, m_c8.V, m_instr.X + 1);
+}
+
+void
+Chip8::OP_FX85()
+{
+    // Load V0 to Vx from the flag registers
+    memcpy(m_c8.V, m_c8.RPL, m_instr.X + 1);
+}
+
+void
+Chip8::OP_00DN()
+{
+    // Scroll the display up N rows
+    ScrollVertical(-(int32_t)m_instr.N);
+}
+
+void
+Chip8::OP_5XY2()
+{
+    // Store Vx through Vy in memory starting at location I, backwards if y < x. I is left alone
+    const int32_t step = m_instr.X <= m_instr.Y ? 1 : -1;
+    const uint32_t count = std::abs(m_instr.Y - m_instr.X) + 1;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        m_c8.RAM[(m_c8.I + i) % TOTAL_RAM] = m_c8.V[m_instr.X + step * (int32_t)i];
+    }
+
+    // Self-modifying code
+    InvalidateCode(m_c8.I, count);
+}
+
+void
+Chip8::OP_5XY3()
+{
+    // Read Vx through Vy from memory starting at location I, backwards if y < x. I is left alone
+    const int32_t step = m_instr.X <= m_instr.Y ? 1 : -1;
+    const uint32_t count = std::abs(m_instr.Y - m_instr.X) + 1;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        m_c8.V[m_instr.X + step * (int32_t)i] = m_c8.RAM[(m_c8.I + i) % TOTAL_RAM];
+    }
+}
+
+void
+Chip8::OP_F000()
+{
+    // Set I = NNNN, the word after the instruction, and step over it
+    m_c8.I = m_c8.RAM[m_c8.PC] << 8 | m_c8.RAM[(m_c8.PC + 1) % TOTAL_RAM];
+    m_c8.PC += 2;
+}
+
+void
+Chip8::OP_FN01()
+{
+    // Select the planes drawn, cleared and scrolled, a bit each
+    m_c8.PLANES = m_instr.X & ((1 << PLANE_COUNT) - 1);
+}
+
+void
+Chip8::OP_F002()
+{
+    // Load the audio pattern from memory starting at location I
+    for (uint32_t i = 0; i < AUDIO_SIZE; ++i)
+    {
+        m_c8.AUDIO[i] = m_c8.RAM[(m_c8.I + i) % TOTAL_RAM];
+    }
+}
+
+void
+Chip8::OP_FX3A()
+{
+    // Set the audio pitch = Vx
+    m_c8.PITCH = m_c8.V[m_instr.X];
+}
+
+uint32_t
+Chip8::OP_ANNN_DXYN(const instruction_t *instrs, uint32_t)
+{
+    // Point I at a sprite and draw it
+    m_c8.I = instrs[0].NNN;
+    m_c8.PC += 4;
+
+    // The table knows how the profile draws, and that DXY0 is a 16x16 sprite on SUPER-CHIP and
+    // nothing otherwise
+    m_instr = instrs[1];
+    (this->*(*m_dispatch)[GetDispatchIndex(m_instr.OP)].function)();
+    UpdateTimers(2);
+
+    return 2;
 }
 
+uint32_t
+Chip8::OP_6XNN_RUN(const instruction_t *instrs, uint32_t length)
+{
+    // Load several registers at once
+    for (uint32_t i = 0; i < length; ++i)
+    {
+        m_c8.V[instrs[i].X] = instrs[i].NN;
+    }
+
+    m_instr = instrs[length - 1];
+    m_c8.PC += length * 2;
+    UpdateTimers(length);
+
+    return length;
+}
+
+uint32_t
+Chip8::OP_7XNN_3XNN_1NNN(const instruction_t *instrs, uint32_t)
+{
+    // Step a counter and loop until it reaches a value
+    m_c8.V[instrs[0].X] += instrs[0].NN;
+    m_instr = instrs[1];
+    UpdateTimers(2);
+
+    if (m_c8.V[instrs[1].X] == instrs[1].NN)
+    {
+        m_c8.PC += 6;
+        return 2;
+    }
+
+    m_instr = instrs[2];
+    m_c8.PC = instrs[2].NNN;
+    UpdateTimers();
+
+    return 3;
+}
+
+uint32_t
+Chip8::OP_FX07_3XNN_1NNN(const instruction_t *instrs, uint32_t)
+{
+    // Poll the delay timer until it reaches a value
+    m_c8.V[instrs[0].X] = m_c8.DT;
+    m_instr = instrs[1];
+    UpdateTimers(2);
+
+    if (m_c8.V[instrs[1].X] == instrs[1].NN)
+    {
+        m_c8.PC += 6;
+        return 2;
+    }
+
+    m_instr = instrs[2];
+    m_c8.PC = instrs[2].NNN;
+    UpdateTimers();
+
+    return 3;
+}
+
+// --------------------------------------------------------------------------------
+
 Chip8::disassembly_t
 Chip8::disassemble(uint16_t nStart, uint16_t nStop) const
 {
@@ -617,19 +1854,18 @@ Chip8::disassemble(uint16_t nStart, uint16_t nStop) const
         line_addr = addr;
 
         instr = instruction_t(m_c8.RAM[addr] << 8 | m_c8.RAM[addr + 1]); addr += 2;
-        uint16_t masked_opcode = GetMaskedOpcode(instr.OP);
+        const instruction_map_t &entry = (*m_dispatch)[GetDispatchIndex(instr.OP)];
 
         sInst = "$" + hex(line_addr, 4) + ": ";
         sInst += hex(instr.OP, 4) + std::string(3, ' ');
 
-        const auto it = m_lookup.find(masked_opcode);
-        if (it != m_lookup.end())
+        if (entry.function != nullptr)
         {
-            sInst += it->second.name;
+            sInst += entry.name;
 
             switch ((instr.OP & 0xF000) >> 12)
             {
-                case 0x0: break;
+                case 0x0: if ((instr.OP & 0xFFE0) == 0x00C0) sInst += " #" + hex(instr.N, 1); break;
                 case 0x1:
                 case 0x2:
                 case 0xA:
@@ -643,8 +1879,15 @@ Chip8::disassemble(uint16_t nStart, uint16_t nStop) const
                 case 0x9:
                 case 0x8: sInst += " V" + hex(instr.X, 1) + ", V" + hex(instr.Y, 1); break;
                 case 0xD: sInst += " V" + hex(instr.X, 1) + ", V" + hex(instr.Y, 1) + ", #" + hex(instr.N, 1); break;
-                case 0xE:
-                case 0xF: sInst += " V" + hex(instr.X, 1); break;
+                case 0xE: sInst += " V" + hex(instr.X, 1); break;
+                case 0xF:
+                {
+                    // XO-CHIP: the long load takes the next word, the plane mask is X
+                    if (instr.OP == 0xF000) sInst += " I, $" + hex(m_c8.RAM[addr % TOTAL_RAM] << 8 | m_c8.RAM[(addr + 1) % TOTAL_RAM], 4);
+                    else if (instr.NN == 0x01) sInst += " #" + hex(instr.X, 1);
+                    else if (instr.NN != 0x02) sInst += " V" + hex(instr.X, 1);
+                    break;
+                }
                 default: break;
             }
         }
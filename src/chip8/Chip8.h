@@ -28,27 +28,50 @@
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <array>
 #include <string>
 #include <map>
+#include <memory>
+#include <random>
 #include <vector>
 
+#include "Quirks.h"
+
 #define cuAssert(x) assert(x)
 
-#define TOTAL_RAM       4096
+#define TOTAL_RAM       0x10000     // XO-CHIP; instructions still only name the first 4KB
 #define TOTAL_REGISTERS 16
 #define STACK_SIZE      16
 #define KEYPAD_SIZE     16
 
-#define DISPLAY_WIDTH   64
-#define DISPLAY_HEIGHT  32
+// SUPER-CHIP hi-res display; the CHIP-8 one is its top left 64x32
+#define DISPLAY_WIDTH   128
+#define DISPLAY_HEIGHT  64
 #define DISPLAY_SIZE    (DISPLAY_WIDTH * DISPLAY_HEIGHT)
+#define DISPLAY_WORDS   (DISPLAY_WIDTH / 64)   // Words per display row
+
+#define LORES_WIDTH     64
+#define LORES_HEIGHT    32
+
+#define PLANE_COUNT     2               // XO-CHIP bitplanes, 4 colors
 
 #define FONT_SET_SIZE    (5 * 16)
+#define BIG_FONT_SIZE    (10 * 16)      // SUPER-CHIP digits, 8x10, right after the small ones
+#define RPL_SIZE         16             // SUPER-CHIP flag registers
+#define AUDIO_SIZE       16             // XO-CHIP audio pattern, 128 one-bit samples
+
+#define TIMER_RATE      60              // Delay and sound timer ticks per second of guest time
+#define CLOCK_RATE      600             // Instructions per second of guest time, unless set
 
 #define PROG_START      0x200
 #define PROG_END        0xFFF
+#define CODE_SIZE       (PROG_END + 1)  // Addresses jumps and calls reach, and the code caches cover
 
 
+// Forward declaration
+class CodeCache;
+class Jit;
+class Aot;
 
 class Chip8
 {
@@ -79,51 +102,232 @@ public:
     typedef struct instruction_map_t
     {
         // Holds the name of the instruction.
-        std::string name;
+        const char* name = nullptr;
 
         // A pointer to the function in the Chip8 class that implements the instruction.
         void (Chip8::*function)(void) = nullptr;
     } instruction_map_t;
 
+    // Flat dispatch table, indexed by GetDispatchIndex()
+    typedef std::array<instruction_map_t, 0x1000> dispatch_table_t;
+
+    // Superinstruction: does the work of the `length` instructions starting at PC, ticking
+    // the timers after each one. Returns the number of instructions actually executed
+    typedef uint32_t (Chip8::*fused_function_t)(const instruction_t *instrs, uint32_t length);
+
+    // Execution backends, selectable at runtime
+    enum class backend_t : uint8_t
+    {
+        Interpreter,    // Fetch, decode and execute one instruction at a time. The reference
+        BlockCache,     // Run predecoded basic blocks
+        Jit,            // Translate hot blocks into native code (x86-64 only)
+        Threaded,       // Every handler jumps straight to the next one (GCC/Clang only)
+        Aot,            // Run a module translated ahead of time by Chip0uAot (dlopen hosts only)
+
+        Count
+    };
+
+    // Quirk profiles, each one with its own instantiation of the instructions
+    enum class profile_t : uint8_t
+    {
+        Chip0u,         // Chip0u's historic mix
+        Chip8,          // COSMAC VIP
+        SuperChip,      // SUPER-CHIP 1.1
+        XoChip,         // XO-CHIP
+
+        Count
+    };
+
+    // Instruction sequences fused by the block cache
+    enum class fusion_t : uint8_t
+    {
+        LoadDraw,       // ANNN, DXYN
+        LoadRun,        // 6XNN, 6XNN, ...
+        CountLoop,      // 7XNN, 3XNN, 1NNN
+        TimerWait,      // FX07, 3XNN, 1NNN
+
+        Count
+    };
+
     typedef struct chip8_t
     {
         uint8_t     V[TOTAL_REGISTERS]; // V0 - VF
-        uint8_t     RAM[TOTAL_RAM];     // 4KB RAM (0x000 - 0xFFF)
+        uint8_t     RAM[TOTAL_RAM];     // 64KB RAM (0x0000 - 0xFFFF)
         uint16_t    PC;                 // Program Counter
         uint16_t    I;                  // Index Register
         uint8_t     DT, ST;             // Delay Timer, Sound Timer
         uint16_t    STACK[STACK_SIZE];  // Stack
         uint8_t     SP;                 // Stack Pointer
-        uint8_t     KP[KEYPAD_SIZE];    // Keypad
-        bool        DP[DISPLAY_SIZE];   // Display
-        bool        DF;                 // Draw Flag
+        uint16_t    KP;                 // Keypad, a bit per key down
+        uint8_t     RPL[RPL_SIZE];      // Flag registers (FX75, FX85)
+        uint8_t     HIRES;              // 128x64 rather than 64x32 display
+        uint8_t     PLANES;             // Bitplanes drawn, cleared and scrolled, one bit each (FN01)
+        uint8_t     PITCH;              // Audio pitch (FX3A)
+        uint8_t     AUDIO[AUDIO_SIZE];  // Audio pattern (F002)
+        uint64_t    DP[PLANE_COUNT][DISPLAY_HEIGHT][DISPLAY_WORDS]; // Display, a bitplane per color bit. DISPLAY_WORDS
+                                                                    // words per row with the leftmost pixel in the
+                                                                    // top bit of the first. The 64x32 display only
+                                                                    // uses the first word of its rows
     } chip8_t;
 
-    /*
+    // A copy of the machine for another thread to draw and inspect while this one runs on: its state,
+    // the size of its display and the generations GetDirtyRows() works from
+    typedef struct frame_t
+    {
+        chip8_t     state;
+        uint32_t    width, height;
+        uint64_t    displayGeneration;
+        uint64_t    rowGenerations[DISPLAY_HEIGHT];
+    } frame_t;
+
+    // Key press or release, due once `cycle` instructions have run since the reset
+    typedef struct key_event_t
+    {
+        uint64_t    cycle;
+        uint8_t     key;
+        bool        state;
+    } key_event_t;
+
+    // Everything a run changes, to roll the machine back to; see SaveSnapshot()
+    typedef struct snapshot_t
+    {
+        chip8_t         state;
+        uint64_t        cycles;
+        std::vector<key_event_t> keys;
+        uint64_t        timerPhase;
+        double          cycleCredit;
+        std::mt19937    rng;
+        uint64_t        drawnRows;
+        uint8_t         drawnPlanes;
+        uint64_t        displayGeneration;
+        uint32_t        serial {0};     // Save it came from, 0 for none
+    } snapshot_t;
+
     typedef struct debug_t
     {
         // PC breakpoint
         uint16_t    PC;
     } debug_t;
-    */
+
+    // Why Run() returned: out of cycles, or right after an event the caller asked to stop on
+    enum class stop_t : uint8_t
+    {
+        Budget,         // Ran all the cycles
+        Draw,           // Changed the display: DXYN, clears, scrolls and mode switches
+        Sound,          // Started the sound timer from 0
+        KeyWait,        // FX0A found no key down
+        Breakpoint,     // About to execute an instruction at a breakpoint
+
+        Count
+    };
+
+    typedef struct run_t
+    {
+        stop_t      reason;
+        uint32_t    cycles;             // Instructions executed
+    } run_t;
 
 public:
     Chip8();
-    ~Chip8() = default;
+    ~Chip8();
 
     void Clock();
+
+    // Run up to `cycles` instructions, returning early after any of the events in `stops`, a
+    // GetStopMask() bit each. Breakpoints run the interpreter, every other stop any backend
+    run_t Run(uint32_t cycles, uint32_t stops = 0);
+    static constexpr uint32_t GetStopMask(stop_t stop);
     void Reset();
+
+    // Guest clock, in instructions per second. The timers tick TIMER_RATE times a second of it,
+    // however many instructions that takes
+    void SetClockRate(uint32_t rate);
+    uint32_t GetClockRate() const;
+
+    // Run for `seconds` of guest time; fractions of an instruction carry over to the next call,
+    // and so do the cycles a stop left unrun
+    run_t RunFor(double seconds, uint32_t stops = 0);
     void LoadGame(const char* filename);
 
+    // Write `size` bytes at `addr`, wrapping around the end, as the program would: whatever was
+    // translated from the old bytes is dropped
+    void WriteMemory(uint16_t addr, const uint8_t* data, uint16_t size);
+
+    // Load a module written by Chip0uAot for the AOT backend; its quirk profile becomes the current one
+    bool LoadAot(const char* filename);
+
+    // Seed the random numbers of CXNN, for runs that have to be reproduced
+    void SetSeed(uint32_t seed);
+
     void SetKey(uint8_t key, bool state);
 
-    //void AddBreakpoint(uint16_t PC);
-    //void RemoveBreakpoint(uint16_t PC);
+    // Press or release a key right before the instruction `cycle` counts up to, see GetCycles(), or
+    // now if that's gone. Keys apply in the order queued
+    void QueueKey(uint64_t cycle, uint8_t key, bool state);
+
+    // Instructions run since the reset
+    uint64_t GetCycles() const;
+
+    void SetBackend(backend_t backend);
+    backend_t GetBackend() const;
+    bool IsBackendAvailable(backend_t backend) const;
+    static const char* GetBackendName(backend_t backend);
+
+    void SetProfile(profile_t profile);
+    profile_t GetProfile() const;
+    static const quirks_t& GetQuirks(profile_t profile);
+
+    // Look up the instruction implementing an opcode
+    static const instruction_map_t& Decode(uint16_t opcode, profile_t profile);
+
+    // Superinstructions
+    static fused_function_t GetFusedFunction(fusion_t fusion);
+    static const char* GetFusionName(fusion_t fusion);
+    uint32_t GetFusionCount(fusion_t fusion) const;
+
+    // Instances sharing the decoded program of the block cache, this one included
+    uint32_t GetCodeShareCount() const;
+
+    void AddBreakpoint(uint16_t PC);
+    void RemoveBreakpoint(uint16_t PC);
+
+    // Whole machine state
+    const chip8_t& GetState() const;
+
+    // Display changes. The generation counts the Run() calls that changed it; a consumer keeps the
+    // last generation it saw and gets the rows changed since, one bit each, or 0 at no cost
+    uint64_t GetDisplayGeneration() const;
+    uint64_t GetDirtyRows(uint64_t &generation) const;
+
+    // Copy the machine into `frame`, and the rows of it changed since `generation`, as GetDirtyRows()
+    void GetFrame(frame_t &frame) const;
+    static uint64_t GetDirtyRows(const frame_t &frame, uint64_t &generation);
+
+    // Save the machine, and roll it back later, for run-ahead. Saving over or restoring the snapshot
+    // saved last only copies the memory written since; any other, or one from before a reset,
+    // copies all of it, and restoring drops every translated block. The rows that change stay
+    // dirty, as after a draw
+    void SaveSnapshot(snapshot_t &snapshot);
+    void RestoreSnapshot(const snapshot_t &snapshot);
+
+    // Frames run while set are rolled back later, so they leave the host alone: the sound timer
+    // running out beeps only when it happens for real
+    void SetSpeculative(bool isSpeculative);
+
+    // Size of the display in its current mode: 64x32, or 128x64 after 00FF
+    uint32_t GetDisplayWidth() const;
+    uint32_t GetDisplayHeight() const;
+    bool     IsHires() const;
+
+    // XO-CHIP audio pattern playback rate, in samples per second
+    float GetAudioRate() const;
 
     // Getters
-    bool       GetDrawFlag();
-    bool*      GetDisplay();
-    uint8_t*   GetMemory();
+    const uint64_t* GetDisplay(uint32_t plane = 0) const;   // DISPLAY_WORDS words per row, see chip8_t::DP
+    void       GetDisplay(bool* pixels) const;    // Expanded to GetDisplayWidth() x GetDisplayHeight() pixels, row by row
+    bool       IsPixelOn(uint8_t x, uint8_t y) const;   // Lit in any plane
+    uint8_t    GetPixel(uint8_t x, uint8_t y) const;    // Color index, a bit per plane
+    const uint8_t* GetMemory() const;   // Write with WriteMemory()
     uint8_t*   GetV();
     uint16_t   GetI();
     uint16_t   GetPC();
@@ -131,7 +335,7 @@ public:
     uint16_t*  GetStack();
     uint8_t    GetDelayTimer();
     uint8_t    GetSoundTimer();
-    uint8_t*   GetKeyboard();
+    uint16_t   GetKeyboard() const;
 
     // Get disassembled instructions
     std::map<uint16_t, std::string> GetDisassembled() const;
@@ -143,14 +347,76 @@ private:
     // Instructions
     instruction_t m_instr{0};
 
-    // Lookup table for instructions
-    std::map<uint16_t, instruction_map_t> m_lookup;
+    // Backend used by Run()
+    backend_t m_backend {backend_t::BlockCache};
+
+    // Quirk profile, and the dispatch table built for it
+    profile_t m_profile {profile_t::Chip0u};
+    const dispatch_table_t *m_dispatch {&s_dispatch[0]};
+
+    // Predecoded instructions for the block cache backend
+    std::unique_ptr<CodeCache> m_cache;
+
+    // Native code for the JIT backend
+    std::unique_ptr<Jit> m_jit;
+
+    // Module loaded for the AOT backend
+    std::unique_ptr<Aot> m_aot;
+
+    // Source of CXNN
+    std::mt19937 m_rng;
+
+    // Guest clock, and how far it is into the current timer tick, in 1/TIMER_RATE instructions: a
+    // tick is due every m_clockRate of them
+    uint32_t m_clockRate {CLOCK_RATE};
+    uint64_t m_timerPhase {0};
+
+    // Instructions RunFor() owes, short of a whole one
+    double m_cycleCredit {0.0};
+
+    // Instructions run since the reset, and the keys queued for later ones, from m_keyNext on
+    uint64_t m_cycles {0};
+    std::vector<key_event_t> m_keys;
+    size_t m_keyNext {0};
+
+    // Rows drawn to during this Run() and since the last clear, the display generation, and the one
+    // each row last changed in
+    uint64_t m_pendingRows {0};
+    uint64_t m_drawnRows {0};
+    uint64_t m_displayGeneration {0};
+    uint64_t m_rowGenerations[DISPLAY_HEIGHT] {};
+
+    // Planes drawn to since they were last cleared; m_drawnRows covers all of them
+    uint8_t m_drawnPlanes {0};
+
+    // The snapshot saved last, and the memory written since it was saved or restored, in
+    // [m_writtenStart, m_writtenEnd)
+    uint32_t m_snapshotSerial {0};
+    uint32_t m_writtenStart {TOTAL_RAM};
+    uint32_t m_writtenEnd {0};
+
+    // Running frames that will be rolled back, see SetSpeculative()
+    bool m_isSpeculative {false};
+
+    static uint64_t GetDirtyRows(const uint64_t* rowGenerations, uint64_t displayGeneration, uint64_t &generation);
+
+    // Copy the machine but for its memory, and the memory in [start, end)
+    static void CopyState(chip8_t &to, const chip8_t &from, uint32_t start, uint32_t end);
+
+    // Lookup tables for instructions, one per profile, built at compile time
+    static const dispatch_table_t s_dispatch[(size_t)profile_t::Count];
+    template <typename Q> static constexpr dispatch_table_t BuildDispatchTable();
 
     // a map of comments for each instruction
     std::map<uint16_t, std::string> m_comments =
     {
         {0x00E0, "Clear the display"},
         {0x00EE, "Return from a subroutine"},
+        {0x00FB, "Scroll the display right by 4 pixels"},
+        {0x00FC, "Scroll the display left by 4 pixels"},
+        {0x00FD, "Exit the interpreter"},
+        {0x00FE, "Switch to the 64x32 display"},
+        {0x00FF, "Switch to the 128x64 display"},
         {0x1, "Jump to address NNN"},
         {0x2, "Call subroutine at NNN"},
         {0x3, "Skip next instruction if Vx = NN"},
@@ -169,16 +435,101 @@ private:
     };
 
     // vector of all breakpoints
-    //std::vector<debug_t> m_breakpoints;
+    std::vector<debug_t> m_breakpoints;
 
-    // Instructions
-    void OP_00E0(), OP_00EE(), OP_1NNN(), OP_2NNN(), OP_3XNN(), OP_4XNN(), OP_5XY0(), OP_6XNN(), OP_7XNN();
-    void OP_8XY0(), OP_8XY1(), OP_8XY2(), OP_8XY3(), OP_8XY4(), OP_8XY5(), OP_8XY6(), OP_8XY7(), OP_8XYE();
-    void OP_9XY0(), OP_ANNN(), OP_BNNN(), OP_CXNN(), OP_DXYN(), OP_EX9E(), OP_EXA1();
-    void OP_FX07(), OP_FX0A(), OP_FX15(), OP_FX18(), OP_FX1E(), OP_FX29(), OP_FX33(), OP_FX55(), OP_FX65();
+    // Events the current Run() stops on, and the one it stops for
+    uint32_t m_stops {0};
+    stop_t   m_stop {stop_t::Budget};
 
-    // Get masked opcode. Make it possible to look up instructions in the lookup table
-    [[nodiscard]] static uint16_t GetMaskedOpcode(uint16_t opcode) ;
+    // Instructions
+    void OP_00E0(), OP_00EE(), OP_1NNN(), OP_2NNN(), OP_6XNN(), OP_7XNN();
+    void OP_8XY0(), OP_8XY4(), OP_8XY5(), OP_8XY7();
+    void OP_ANNN(), OP_CXNN();
+    void OP_FX07(), OP_FX0A(), OP_FX15(), OP_FX18(), OP_FX29(), OP_FX33();
+
+    // SUPER-CHIP instructions
+    void OP_00CN(), OP_00FB(), OP_00FC(), OP_00FD(), OP_00FE(), OP_00FF();
+    void OP_FX30(), OP_FX75(), OP_FX85();
+
+    // Draw `height` rows of a sprite at (Vx, Vy) from I, 16 pixels wide rather than 8 if `isWide`
+    template <typename Q, bool isWide> void DrawSprite(uint32_t height);
+
+    // Switch display mode, which clears it
+    void SetHires(bool isHires);
+
+    // XO-CHIP instructions
+    void OP_00DN(), OP_5XY2(), OP_5XY3(), OP_F000(), OP_FN01(), OP_F002(), OP_FX3A();
+
+    // Scroll the selected planes by `rows` rows down, or up when negative
+    void ScrollVertical(int32_t rows);
+
+    // Instructions depending on the quirk policy
+    template <typename Q> void OP_3XNN();
+    template <typename Q> void OP_4XNN();
+    template <typename Q> void OP_5XY0();
+    template <typename Q> void OP_9XY0();
+    template <typename Q> void OP_DXYN();
+    template <typename Q> void OP_DXY0();
+    template <typename Q> void OP_EX9E();
+    template <typename Q> void OP_EXA1();
+    template <typename Q> void OP_8XY1();
+    template <typename Q> void OP_8XY2();
+    template <typename Q> void OP_8XY3();
+    template <typename Q> void OP_8XY6();
+    template <typename Q> void OP_8XYE();
+    template <typename Q> void OP_BNNN();
+    template <typename Q> void OP_FX1E();
+    template <typename Q> void OP_FX55();
+    template <typename Q> void OP_FX65();
+
+    // Skip the next instruction, all four bytes of it for an XO-CHIP F000 NNNN
+    template <typename Q> void SkipNext();
+
+    // Superinstructions
+    uint32_t OP_ANNN_DXYN(const instruction_t *instrs, uint32_t length);
+    uint32_t OP_6XNN_RUN(const instruction_t *instrs, uint32_t length);
+    uint32_t OP_7XNN_3XNN_1NNN(const instruction_t *instrs, uint32_t length);
+    uint32_t OP_FX07_3XNN_1NNN(const instruction_t *instrs, uint32_t length);
+
+    // Backends, each returning the cycles executed. `isStarted` if this Run() ran an instruction
+    // already, so a breakpoint at PC stops it
+    uint32_t RunInterpreter(uint32_t cycles, bool isStarted = false);
+    uint32_t RunBlocks(uint32_t cycles);
+    uint32_t RunJit(uint32_t cycles);
+    uint32_t RunThreaded(uint32_t cycles);
+    template <typename Q> uint32_t RunThreaded(uint32_t cycles);
+    uint32_t RunAot(uint32_t cycles);
+
+    // Apply the keys queued up to the current instruction
+    void ApplyKeys();
+
+    // An event happened; stop after the current instruction if Run() was asked to
+    void Raise(stop_t stop);
+    bool IsBreakpoint(uint16_t PC) const;
+
+    // Instructions that may raise an event, among the handlers of quirk policy Q, which the threaded
+    // backend checks for after them
+    template <typename Q> static constexpr bool CanStop(void (Chip8::*function)(void));
+
+    // Stamp the rows drawn to with a new display generation
+    void PublishRows();
+
+    // Advance the guest clock by `cycles` instructions, ticking the timers on the way
+    void UpdateTimers(uint32_t cycles = 1);
+
+    // Delay timer after `cycles` more instructions
+    uint8_t GetDelayTimerAfter(uint32_t cycles) const;
+
+    // Fast-forward through a loop at PC that only waits on the delay timer or a key press,
+    // leaving the same state running it would have. Returns the cycles skipped, 0 if not idle
+    uint32_t SkipIdle(uint32_t cycles);
+
+    // Memory in [addr, addr + size) was written; drop any code translated from it
+    void InvalidateCode(uint16_t addr, uint16_t size);
+
+    // Get the dispatch table index of an opcode: first nibble followed by the low byte.
+    // Operand bits are covered by the table itself, so unknown opcodes map to empty entries
+    [[nodiscard]] static constexpr uint16_t GetDispatchIndex(uint16_t opcode);
 
     // Produces a map of strings, with keys equivalent to instruction start locations
     // in memory, for the specified address range
@@ -186,27 +537,177 @@ private:
     disassembly_t disassemble(uint16_t nStart, uint16_t nStop) const;
 };
 
+constexpr uint16_t
+Chip8::GetDispatchIndex(uint16_t opcode)
+{
+    return ((opcode & 0xF000) >> 4) | (opcode & 0x00FF);
+}
+
+constexpr uint32_t
+Chip8::GetStopMask(stop_t stop)
+{
+    return 1u << (uint32_t)stop;
+}
+
+template <typename Q>
+constexpr bool
+Chip8::CanStop(void (Chip8::*function)(void))
+{
+    return function == &Chip8::OP_00E0 || function == &Chip8::OP_00CN || function == &Chip8::OP_00DN ||
+           function == &Chip8::OP_00FB || function == &Chip8::OP_00FC || function == &Chip8::OP_00FE ||
+           function == &Chip8::OP_00FF || function == &Chip8::OP_DXYN<Q> || function == &Chip8::OP_DXY0<Q> ||
+           function == &Chip8::OP_FX18 || function == &Chip8::OP_FX0A;
+}
+
+inline void
+Chip8::Raise(stop_t stop)
+{
+    if (m_stops & GetStopMask(stop)) m_stop = stop;
+}
+
 inline void
 Chip8::SetKey(uint8_t key, bool state)
 {
     cuAssert(key < 16 && "Invalid key");
-    m_c8.KP[key] = state;
+    m_c8.KP = state ? m_c8.KP | 1 << key : m_c8.KP & ~(1 << key);
+}
+
+inline uint64_t
+Chip8::GetCycles() const
+{
+    return m_cycles;
+}
+
+inline void
+Chip8::SetBackend(backend_t backend)
+{
+    cuAssert(backend < backend_t::Count && "Invalid backend");
+    if (IsBackendAvailable(backend)) m_backend = backend;
+}
+
+inline Chip8::backend_t
+Chip8::GetBackend() const
+{
+    return m_backend;
+}
+
+inline const char*
+Chip8::GetBackendName(backend_t backend)
+{
+    switch (backend)
+    {
+        case backend_t::Interpreter: return "Interpreter";
+        case backend_t::BlockCache:  return "Block Cache";
+        case backend_t::Jit:         return "JIT (x86-64)";
+        case backend_t::Threaded:    return "Threaded";
+        case backend_t::Aot:         return "AOT module";
+        default:                     return "Unknown";
+    }
+}
+
+inline Chip8::profile_t
+Chip8::GetProfile() const
+{
+    return m_profile;
+}
+
+inline const quirks_t&
+Chip8::GetQuirks(profile_t profile)
+{
+    switch (profile)
+    {
+        case profile_t::Chip8:     return Chip8Quirks::value;
+        case profile_t::SuperChip: return SuperChipQuirks::value;
+        case profile_t::XoChip:    return XoChipQuirks::value;
+        default:                   return Chip0uQuirks::value;
+    }
+}
+
+inline const Chip8::instruction_map_t&
+Chip8::Decode(uint16_t opcode, profile_t profile)
+{
+    cuAssert(profile < profile_t::Count && "Invalid profile");
+    return s_dispatch[(size_t)profile][GetDispatchIndex(opcode)];
+}
+
+inline Chip8::fused_function_t
+Chip8::GetFusedFunction(fusion_t fusion)
+{
+    switch (fusion)
+    {
+        case fusion_t::LoadDraw:  return &Chip8::OP_ANNN_DXYN;
+        case fusion_t::LoadRun:   return &Chip8::OP_6XNN_RUN;
+        case fusion_t::CountLoop: return &Chip8::OP_7XNN_3XNN_1NNN;
+        case fusion_t::TimerWait: return &Chip8::OP_FX07_3XNN_1NNN;
+        default:                  return nullptr;
+    }
+}
+
+inline const char*
+Chip8::GetFusionName(fusion_t fusion)
+{
+    switch (fusion)
+    {
+        case fusion_t::LoadDraw:  return "ANNN+DXYN";
+        case fusion_t::LoadRun:   return "6XNN run";
+        case fusion_t::CountLoop: return "7XNN+3XNN+1NNN";
+        case fusion_t::TimerWait: return "FX07+3XNN+1NNN";
+        default:                  return "Unknown";
+    }
+}
+
+inline uint32_t
+Chip8::GetDisplayWidth() const
+{
+    return m_c8.HIRES ? DISPLAY_WIDTH : LORES_WIDTH;
+}
+
+inline uint32_t
+Chip8::GetDisplayHeight() const
+{
+    return m_c8.HIRES ? DISPLAY_HEIGHT : LORES_HEIGHT;
 }
 
 inline bool
-Chip8::GetDrawFlag()
+Chip8::IsHires() const
 {
-    return m_c8.DF;
+    return m_c8.HIRES != 0;
 }
 
-inline bool*
-Chip8::GetDisplay()
+inline const uint64_t*
+Chip8::GetDisplay(uint32_t plane) const
 {
-    return m_c8.DP;
+    return &m_c8.DP[plane][0][0];
 }
 
-inline uint8_t*
-Chip8::GetMemory()
+inline void
+Chip8::GetDisplay(bool* pixels) const
+{
+    for (uint32_t y = 0; y < GetDisplayHeight(); ++y)
+    {
+        for (uint32_t x = 0; x < GetDisplayWidth(); ++x) *pixels++ = IsPixelOn(x, y);
+    }
+}
+
+inline bool
+Chip8::IsPixelOn(uint8_t x, uint8_t y) const
+{
+    return GetPixel(x, y) != 0;
+}
+
+inline uint8_t
+Chip8::GetPixel(uint8_t x, uint8_t y) const
+{
+    uint8_t color = 0;
+    for (uint32_t plane = 0; plane < PLANE_COUNT; ++plane)
+    {
+        color |= ((m_c8.DP[plane][y][x / 64] >> (63 - x % 64)) & 1) << plane;
+    }
+    return color;
+}
+
+inline const uint8_t*
+Chip8::GetMemory() const
 {
     return m_c8.RAM;
 }
@@ -241,6 +742,73 @@ Chip8::GetStack()
     return m_c8.STACK;
 }
 
+inline uint32_t
+Chip8::GetClockRate() const
+{
+    return m_clockRate;
+}
+
+inline void
+Chip8::SetSeed(uint32_t seed)
+{
+    m_rng.seed(seed);
+}
+
+inline void
+Chip8::SetSpeculative(bool isSpeculative)
+{
+    m_isSpeculative = isSpeculative;
+}
+
+inline const Chip8::chip8_t&
+Chip8::GetState() const
+{
+    return m_c8;
+}
+
+inline uint64_t
+Chip8::GetDisplayGeneration() const
+{
+    return m_displayGeneration;
+}
+
+inline uint64_t
+Chip8::GetDirtyRows(uint64_t &generation) const
+{
+    return GetDirtyRows(m_rowGenerations, m_displayGeneration, generation);
+}
+
+inline uint64_t
+Chip8::GetDirtyRows(const frame_t &frame, uint64_t &generation)
+{
+    return GetDirtyRows(frame.rowGenerations, frame.displayGeneration, generation);
+}
+
+inline uint64_t
+Chip8::GetDirtyRows(const uint64_t* rowGenerations, uint64_t displayGeneration, uint64_t &generation)
+{
+    if (generation == displayGeneration) return 0;
+
+    uint64_t rows = 0;
+    for (uint32_t y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        rows |= (uint64_t)(rowGenerations[y] > generation) << y;
+    }
+
+    generation = displayGeneration;
+    return rows;
+}
+
+inline void
+Chip8::GetFrame(frame_t &frame) const
+{
+    frame.state = m_c8;
+    frame.width = GetDisplayWidth();
+    frame.height = GetDisplayHeight();
+    frame.displayGeneration = m_displayGeneration;
+    memcpy(frame.rowGenerations, m_rowGenerations, sizeof(frame.rowGenerations));
+}
+
 inline uint8_t
 Chip8::GetDelayTimer()
 {
@@ -253,8 +821,8 @@ Chip8::GetSoundTimer()
     return m_c8.ST;
 }
 
-inline uint8_t*
-Chip8::GetKeyboard()
+inline uint16_t
+Chip8::GetKeyboard() const
 {
     return m_c8.KP;
 }
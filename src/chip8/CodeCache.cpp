@@ -0,0 +1,340 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "CodeCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+
+// FNV-1a over the memory and the profile
+static uint64_t
+Hash(const uint8_t* ram, Chip8::profile_t profile)
+{
+    uint64_t hash = 0xCBF29CE484222325ull ^ (uint64_t)profile;
+    for (uint32_t i = 0; i < CODE_SIZE; ++i)
+    {
+        hash = (hash ^ ram[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+
+CodeCache::program_t::program_t()
+    : entries(CODE_SIZE)
+    , instrs(CODE_SIZE, Chip8::instruction_t(0))
+{
+}
+
+CodeCache::CodeCache(const uint8_t* ram)
+    : m_ram(ram)
+{
+}
+
+
+
+const CodeCache::decoded_t*
+CodeCache::GetOwnBlock(uint16_t pc, const Chip8::instruction_t* &instrs)
+{
+    // The last byte can't hold a whole instruction
+    if (pc >= CODE_SIZE - 1) return nullptr;
+
+    // Picked once the memory is set up, rather than for every step of a reset and load
+    if (m_shared == nullptr)
+    {
+        m_shared = Acquire(m_ram, m_profile);
+        m_entries = m_shared->entries.data();
+        m_instrs = m_shared->instrs.data();
+    }
+
+    if (!m_overridden[pc])
+    {
+        instrs = &m_instrs[GetLaneIndex(pc)];
+        return &m_entries[pc];
+    }
+
+    if (m_local == nullptr) m_local = std::make_unique<program_t>();
+    if (m_local->entries[pc].length == 0) Decode(*m_local, m_ram, m_profile, pc);
+
+    instrs = &m_local->instrs[GetLaneIndex(pc)];
+    return &m_local->entries[pc];
+}
+
+void
+CodeCache::Invalidate(uint16_t addr, uint16_t size)
+{
+    // The program isn't picked yet, and will be decoded with the write in
+    if (m_shared == nullptr) return;
+
+    uint32_t end = std::min<uint32_t>(addr + size, CODE_SIZE);
+
+    // Shared blocks running over the write are decoded again from this memory
+    uint32_t first = addr > (MAX_BLOCK_LENGTH + MAX_FUSED_LENGTH) * 2 ? addr - (MAX_BLOCK_LENGTH + MAX_FUSED_LENGTH) * 2 : 0;
+    for (uint32_t pc = first; pc < end; ++pc)
+    {
+        if (m_shared->reach[pc] > addr) m_overridden[pc] = true;
+    }
+
+    if (m_local != nullptr) Drop(*m_local, addr, size);
+}
+
+void
+CodeCache::Clear()
+{
+    m_shared.reset();
+    m_entries = nullptr;
+    m_instrs = nullptr;
+    m_local.reset();
+    m_overridden.reset();
+}
+
+uint32_t
+CodeCache::GetFusionCount(Chip8::fusion_t fusion) const
+{
+    cuAssert(fusion < Chip8::fusion_t::Count && "Invalid fusion");
+    if (m_shared == nullptr) return 0;
+
+    Chip8::fused_function_t function = Chip8::GetFusedFunction(fusion);
+    uint32_t count = 0;
+    for (uint32_t pc = 0; pc < CODE_SIZE; ++pc)
+    {
+        const decoded_t* entry = !m_overridden[pc] ? &m_entries[pc] : m_local != nullptr ? &m_local->entries[pc] : nullptr;
+        count += entry != nullptr && entry->length != 0 && entry->fused == function;
+    }
+    return count;
+}
+
+void
+CodeCache::SetProfile(Chip8::profile_t profile)
+{
+    m_profile = profile;
+    Clear();
+}
+
+std::shared_ptr<const CodeCache::program_t>
+CodeCache::Acquire(const uint8_t* ram, Chip8::profile_t profile)
+{
+    // Programs by hash of their image and profile; they go away with their last cache
+    static std::mutex mutex;
+    static std::unordered_multimap<uint64_t, std::weak_ptr<const program_t>> programs;
+
+    uint64_t hash = Hash(ram, profile);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::erase_if(programs, [](const auto &item) { return item.second.expired(); });
+
+    auto [first, last] = programs.equal_range(hash);
+    for (auto it = first; it != last; ++it)
+    {
+        auto program = it->second.lock();
+        if (program != nullptr && program->profile == profile && memcmp(program->image.data(), ram, CODE_SIZE) == 0) return program;
+    }
+
+    // First cache with this image: decode every address, so the program never changes again.
+    // Each entry gets the block a decode from its own address gives; the tail of a block cut at
+    // MAX_BLOCK_LENGTH doesn't have it, so it's decoded again
+    // Not make_shared: the registry's weak reference would keep the memory of a dropped program
+    std::shared_ptr<program_t> program(new program_t());
+    program->image.assign(ram, ram + CODE_SIZE);
+    program->profile = profile;
+
+    std::bitset<CODE_SIZE> isCut;
+    for (uint32_t pc = 0; pc < CODE_SIZE - 1; ++pc)
+    {
+        const decoded_t &entry = program->entries[pc];
+        if (entry.length != 0 && !isCut[pc]) continue;
+
+        Decode(*program, program->image.data(), profile, pc);
+
+        uint32_t last = pc + (entry.length - 1) * 2;
+        bool isFull = entry.length == MAX_BLOCK_LENGTH && !IsBlockEnd(program->instrs[GetLaneIndex(last)].OP);
+        for (uint32_t at = pc + 2; at <= last; at += 2) isCut[at] = isFull;
+    }
+
+    program->reach.resize(CODE_SIZE);
+    for (uint32_t pc = 0; pc < CODE_SIZE - 1; ++pc)
+    {
+        uint32_t reach = pc;
+        for (uint32_t i = 0; i < program->entries[pc].length; ++i)
+        {
+            const decoded_t &entry = program->entries[pc + i * 2];
+            reach = std::max<uint32_t>(reach, pc + (i + std::max<uint32_t>(entry.fusedLength, 1)) * 2);
+        }
+        program->reach[pc] = reach;
+    }
+
+    programs.emplace(hash, program);
+    return program;
+}
+
+void
+CodeCache::Drop(program_t &program, uint16_t addr, uint16_t size)
+{
+    uint32_t end = std::min<uint32_t>(addr + size, CODE_SIZE);
+
+    // Nothing decoded there, which is the case for almost every data write
+    bool isCode = false;
+    for (uint32_t i = addr; i < end && !isCode; ++i) isCode = program.code[i];
+    if (!isCode) return;
+
+    // Any block starting up to MAX_BLOCK_LENGTH instructions before may run over the write
+    uint32_t first = addr > MAX_BLOCK_LENGTH * 2 ? addr - MAX_BLOCK_LENGTH * 2 : 0;
+    for (uint32_t pc = first; pc < end; ++pc)
+    {
+        decoded_t &entry = program.entries[pc];
+        uint32_t span = std::max(entry.length, entry.fusedLength);
+        if (entry.length != 0 && pc + span * 2 > addr)
+        {
+            entry.length = 0;
+            entry.fused = nullptr;
+            entry.fusedLength = 0;
+            entry.idle = false;
+        }
+    }
+
+    // Rebuild the code map around the write from what survived.
+    // Superinstructions may cover one instruction past their block
+    uint32_t last = std::min<uint32_t>(end + 1, CODE_SIZE);
+    uint32_t from = first > MAX_FUSED_LENGTH * 2 ? first - MAX_FUSED_LENGTH * 2 : 0;
+    for (uint32_t i = first; i < last; ++i) program.code[i] = false;
+    for (uint32_t pc = from; pc < last; ++pc)
+    {
+        const decoded_t &entry = program.entries[pc];
+        if (entry.length == 0) continue;
+
+        uint32_t span = std::max<uint32_t>(entry.fusedLength, 1);
+        for (uint32_t i = pc; i < std::min<uint32_t>(pc + span * 2, CODE_SIZE); ++i) program.code[i] = true;
+    }
+}
+
+bool
+CodeCache::IsBlockEnd(uint16_t opcode)
+{
+    switch ((opcode & 0xF000) >> 12)
+    {
+        case 0x0: return true;
+        case 0x1:
+        case 0x2:
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        case 0xB:
+        case 0xD:
+        case 0xE: return true;
+        case 0xF:
+        {
+            uint8_t nn = opcode & 0x00FF;
+            return nn == 0x00 || nn == 0x0A || nn == 0x33 || nn == 0x55;   // F000 NNNN moves the PC past its address
+        }
+        default: return false;
+    }
+}
+
+void
+CodeCache::Decode(program_t &program, const uint8_t* ram, Chip8::profile_t profile, uint16_t pc)
+{
+    // Decode straight-line code up to the block end
+    uint32_t count = 0;
+    uint32_t addr = pc;
+    while (count < MAX_BLOCK_LENGTH && addr < CODE_SIZE - 1)
+    {
+        uint16_t opcode = ram[addr] << 8 | ram[addr + 1];
+
+        decoded_t &entry = program.entries[addr];
+        entry.function = Chip8::Decode(opcode, profile).function;
+        entry.fused = nullptr;
+        entry.fusedLength = 0;
+        entry.idle = (opcode & 0xF0FF) == 0xF00A;
+        program.instrs[GetLaneIndex(addr)] = Chip8::instruction_t(opcode);
+
+        program.code[addr] = true;
+        program.code[addr + 1] = true;
+
+        ++count;
+        addr += 2;
+
+        if (IsBlockEnd(opcode)) break;
+    }
+
+    // Every entry of the run is the start of a (shorter) block as well
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        program.entries[pc + i * 2].length = count - i;
+    }
+
+    Fuse(program, ram, pc, count);
+}
+
+void
+CodeCache::Fuse(program_t &program, const uint8_t* ram, uint16_t pc, uint32_t count)
+{
+    const Chip8::instruction_t *instrs = &program.instrs[GetLaneIndex(pc)];
+    auto is = [&](uint32_t i, uint16_t mask, uint16_t value)
+    {
+        return (instrs[i].OP & mask) == value;
+    };
+
+    // A skip ending the block may be followed by a jump, which gets fused in as well
+    uint32_t next = pc + count * 2;
+    bool isSkipOverJump = is(count - 1, 0xF000, 0x3000) && next < CODE_SIZE - 1
+                       && ((ram[next] << 8 | ram[next + 1]) & 0xF000) == 0x1000;
+    if (isSkipOverJump)
+    {
+        program.instrs[GetLaneIndex(next)] = Chip8::instruction_t(ram[next] << 8 | ram[next + 1]);
+    }
+
+    auto fuse = [&](uint32_t i, Chip8::fusion_t fusion, uint32_t length)
+    {
+        decoded_t &entry = program.entries[pc + i * 2];
+        entry.fused = Chip8::GetFusedFunction(fusion);
+        entry.fusedLength = length;
+        for (uint32_t at = pc + i * 2; at < pc + (i + length) * 2; ++at) program.code[at] = true;
+    };
+
+    uint32_t loads = 0;
+    for (int32_t i = count - 1; i >= 0; --i)
+    {
+        // Runs of loads, counted from the back
+        loads = is(i, 0xF000, 0x6000) ? std::min<uint32_t>(loads + 1, MAX_FUSED_LENGTH) : 0;
+        if (loads >= 2)
+        {
+            fuse(i, Chip8::fusion_t::LoadRun, loads);
+        }
+        else if (is(i, 0xF000, 0xA000) && i + 1 < (int32_t)count && is(i + 1, 0xF000, 0xD000))
+        {
+            fuse(i, Chip8::fusion_t::LoadDraw, 2);
+        }
+        else if (isSkipOverJump && i + 2 == (int32_t)count)
+        {
+            if (is(i, 0xF000, 0x7000)) fuse(i, Chip8::fusion_t::CountLoop, 3);
+            else if (is(i, 0xF0FF, 0xF007))
+            {
+                fuse(i, Chip8::fusion_t::TimerWait, 3);
+                program.entries[pc + i * 2].idle = instrs[i + 2].NNN == pc + i * 2;
+            }
+        }
+    }
+}
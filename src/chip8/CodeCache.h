@@ -0,0 +1,179 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_CODECACHE_H
+#define CHIP0U_CODECACHE_H
+
+#include <bitset>
+#include <memory>
+#include <vector>
+
+#include "Chip8.h"
+
+#define MAX_BLOCK_LENGTH 32
+#define MAX_FUSED_LENGTH 8
+
+
+// Predecoded instructions, keyed by the address they were fetched from.
+// Every entry also knows how many instructions are left until the end of its
+// basic block, so a block starting at PC is simply the run of entries at PC, PC + 2, ...
+//
+// Common idioms are fused into superinstructions while decoding: the first entry of the
+// sequence gets a handler doing the work of the whole sequence in one call.
+//
+// Caches holding the same memory image under the same quirk profile share one predecoded,
+// immutable program, found by a hash of the image. A cache only decodes on its own where its
+// memory was written over the shared program, so every instance of a ROM but the first starts
+// warm and costs a few hundred bytes.
+class CodeCache
+{
+public:
+    typedef struct decoded_t
+    {
+        // Handler of the instruction, nullptr for unknown opcodes
+        void (Chip8::*function)(void) = nullptr;
+
+        // Superinstruction starting here, nullptr if none
+        Chip8::fused_function_t fused = nullptr;
+
+        // Instructions left in the block, this one included. 0 if not decoded yet
+        uint8_t length = 0;
+
+        // Instructions the superinstruction may run. It can go one past the end of
+        // the block, for a skip over a jump
+        uint8_t fusedLength = 0;
+
+        // Head of a loop that may be waiting on the delay timer or a key press
+        bool idle = false;
+    } decoded_t;
+
+public:
+    explicit CodeCache(const uint8_t* ram);
+    ~CodeCache() = default;
+
+    // Get the block starting at PC, decoding it if needed, and the decoded operands of its
+    // instructions at PC, PC + 2, ... Returns nullptr if PC can't be cached (last byte of the memory)
+    const decoded_t* GetBlock(uint16_t pc, const Chip8::instruction_t* &instrs);
+
+    // Drop every block overlapping [addr, addr + size)
+    void Invalidate(uint16_t addr, uint16_t size);
+
+    // Drop every block and start over from the current memory
+    void Clear();
+
+    // Decode with the handlers of another quirk profile, dropping every block
+    void SetProfile(Chip8::profile_t profile);
+
+    // Decoded entries starting a superinstruction of a kind
+    uint32_t GetFusionCount(Chip8::fusion_t fusion) const;
+
+    // Caches sharing the decoded program, this one included
+    uint32_t GetShareCount() const;
+
+    // Ends a block: anything that may change the PC, draw or write to memory
+    [[nodiscard]] static bool IsBlockEnd(uint16_t opcode);
+
+private:
+    typedef struct program_t
+    {
+        program_t();
+
+        // One entry per address; a block is the run of entries at stride 2
+        std::vector<decoded_t> entries;
+
+        // Decoded operands, see GetLaneIndex()
+        std::vector<Chip8::instruction_t> instrs;
+
+        // Bytes covered by a decoded instruction
+        std::bitset<CODE_SIZE> code;
+
+        // End of the bytes each block runs, superinstructions of its entries included.
+        // Shared programs only
+        std::vector<uint16_t> reach;
+
+        // What a shared program was decoded from
+        std::vector<uint8_t> image;
+        Chip8::profile_t profile {Chip8::profile_t::Chip0u};
+    } program_t;
+
+    // GetBlock() off the shared path: picking the program, or blocks decoded from this memory
+    const decoded_t* GetOwnBlock(uint16_t pc, const Chip8::instruction_t* &instrs);
+
+    // Shared program of a memory image, decoding it if no other cache holds it
+    static std::shared_ptr<const program_t> Acquire(const uint8_t* ram, Chip8::profile_t profile);
+
+    static void Decode(program_t &program, const uint8_t* ram, Chip8::profile_t profile, uint16_t pc);
+    static void Fuse(program_t &program, const uint8_t* ram, uint16_t pc, uint32_t count);
+
+    // Drop every block of a program overlapping [addr, addr + size)
+    static void Drop(program_t &program, uint16_t addr, uint16_t size);
+
+    // Operands are stored in two lanes, even and odd addresses, so that the
+    // instructions of a block are contiguous
+    [[nodiscard]] static constexpr size_t GetLaneIndex(uint16_t addr);
+
+private:
+    // Memory the instructions are fetched from
+    const uint8_t* m_ram {nullptr};
+
+    // Quirk profile the handlers are taken from
+    Chip8::profile_t m_profile {Chip8::profile_t::Chip0u};
+
+    // Every address of the memory image, decoded. Picked on the first GetBlock() after a Clear()
+    std::shared_ptr<const program_t> m_shared;
+
+    // Arrays of m_shared, read for every block
+    const decoded_t*            m_entries {nullptr};
+    const Chip8::instruction_t* m_instrs {nullptr};
+
+    // Blocks decoded from this memory, allocated on the first write over shared code
+    std::unique_ptr<program_t> m_local;
+
+    // Addresses whose shared block ran over a write; their blocks come from m_local
+    std::bitset<CODE_SIZE> m_overridden;
+};
+
+inline const CodeCache::decoded_t*
+CodeCache::GetBlock(uint16_t pc, const Chip8::instruction_t* &instrs)
+{
+    if (m_entries != nullptr && pc < CODE_SIZE - 1 && !m_overridden[pc])
+    {
+        instrs = &m_instrs[GetLaneIndex(pc)];
+        return &m_entries[pc];
+    }
+
+    return GetOwnBlock(pc, instrs);
+}
+
+inline uint32_t
+CodeCache::GetShareCount() const
+{
+    return m_shared.use_count();
+}
+
+constexpr size_t
+CodeCache::GetLaneIndex(uint16_t addr)
+{
+    return (addr & 1) * (CODE_SIZE / 2) + (addr >> 1);
+}
+
+#endif //CHIP0U_CODECACHE_H
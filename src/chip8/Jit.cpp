@@ -0,0 +1,571 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Jit.h"
+
+#include "CodeCache.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#if defined(CHIP0U_JIT)
+#include <sys/mman.h>
+#endif
+
+// chip8_t fields, addressed from RBX
+#define OFF_V(x)    ((uint32_t)offsetof(Chip8::chip8_t, V) + (x))
+#define OFF_PC      ((uint32_t)offsetof(Chip8::chip8_t, PC))
+#define OFF_I       ((uint32_t)offsetof(Chip8::chip8_t, I))
+#define OFF_STACK   ((uint32_t)offsetof(Chip8::chip8_t, STACK))
+#define OFF_SP      ((uint32_t)offsetof(Chip8::chip8_t, SP))
+#define OFF_KP      ((uint32_t)offsetof(Chip8::chip8_t, KP))
+
+// Host registers used as operands
+#define REG_EAX 0
+#define REG_ECX 1
+#define REG_EDX 2
+
+// Largest block, in bytes of generated code
+#define JIT_MAX_BLOCK_SIZE 4096
+
+
+Jit::Jit()
+{
+}
+
+Jit::~Jit()
+{
+#if defined(CHIP0U_JIT)
+    if (m_buffer != nullptr) munmap(m_buffer, JIT_BUFFER_SIZE);
+#endif
+}
+
+
+
+uint32_t
+Jit::Execute(Chip8::chip8_t &c8, uint32_t cycles)
+{
+    if (c8.PC >= CODE_SIZE || !Reserve()) return 0;
+
+    uint16_t pc = c8.PC;
+    const uint8_t *entry = m_entries[pc];
+    if (entry == m_exit)
+    {
+        // Only translate what runs often enough to pay for it
+        if (m_rejected[pc] || ++m_hits[pc] < JIT_HOT_THRESHOLD) return 0;
+
+        // The block and the jumps linked to it are written in one go, then the buffer runs again
+        if (!SetWritable(true)) return 0;
+        entry = Compile(c8, pc);
+        if (!SetWritable(false)) return 0;
+
+        if (entry == nullptr)
+        {
+            m_rejected[pc] = true;
+            return 0;
+        }
+    }
+
+    uint32_t left = m_enter(&c8, cycles, entry);
+    return cycles - left;
+}
+
+void
+Jit::Invalidate(uint16_t addr, uint16_t size)
+{
+    uint32_t end = std::min<uint32_t>(addr + size, CODE_SIZE);
+    for (uint32_t i = addr; i < end; ++i)
+    {
+        // Blocks are chained to each other, so unlinking just one isn't worth it
+        if (m_code[i])
+        {
+            Clear();
+            return;
+        }
+    }
+}
+
+void
+Jit::Clear()
+{
+    if (m_buffer == nullptr) return;
+
+    m_used = m_stubsSize;
+
+    for (auto &entry : m_entries) entry = m_exit;
+    for (auto &links : m_links) links.clear();
+    for (auto &hits : m_hits) hits = 0;
+
+    m_rejected.reset();
+    m_code.reset();
+}
+
+void
+Jit::SetProfile(Chip8::profile_t profile)
+{
+    m_profile = profile;
+    m_quirks = Chip8::GetQuirks(profile);
+    Clear();
+}
+
+bool
+Jit::Reserve()
+{
+    if (m_hasFailed) return false;
+    if (m_buffer != nullptr) return true;
+
+#if defined(CHIP0U_JIT)
+    // Writable for now; never writable and executable at once, see SetWritable()
+    void *buffer = mmap(nullptr, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED)
+    {
+        printf("JIT: unable to allocate executable memory\n");
+        m_hasFailed = true;
+        return false;
+    }
+
+    m_buffer = (uint8_t*)buffer;
+    m_entries.resize(CODE_SIZE);
+    m_links.resize(CODE_SIZE);
+    m_hits.resize(CODE_SIZE);
+
+    EmitStubs();
+    Clear();
+    return SetWritable(false);
+#else
+    return false;
+#endif
+}
+
+bool
+Jit::SetWritable(bool isWritable)
+{
+#if defined(CHIP0U_JIT)
+    const int protection = isWritable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+    if (mprotect(m_buffer, JIT_BUFFER_SIZE, protection) == 0) return true;
+
+    printf("JIT: unable to make the code buffer %s\n", isWritable ? "writable" : "executable");
+    m_hasFailed = true;
+#endif
+    return false;
+}
+
+bool
+Jit::IsCompilable(uint16_t opcode) const
+{
+    // Unknown opcodes do nothing, which is easy enough to translate
+    if (Chip8::Decode(opcode, m_profile).function == nullptr) return true;
+
+    uint8_t nn = opcode & 0x00FF;
+    switch ((opcode & 0xF000) >> 12)
+    {
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        case 0xE: return !Chip8::GetQuirks(m_profile).xo_chip;  // XO-CHIP skips step over F000 NNNN
+        case 0x0: return nn == 0xEE;                // Display, scrolls and modes are left out
+        case 0xC:                                   // Random numbers
+        case 0xD: return false;                     // Display
+        case 0xF: return nn == 0x1E || nn == 0x29;  // Timers, keys and memory are left out
+        default: return true;
+    }
+}
+
+bool
+Jit::IsBlockEnd(uint16_t opcode) const
+{
+    if (Chip8::Decode(opcode, m_profile).function == nullptr) return false;
+
+    switch ((opcode & 0xF000) >> 12)
+    {
+        case 0x0:
+        case 0x1:
+        case 0x2:
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        case 0xB:
+        case 0xE: return true;
+        default: return false;
+    }
+}
+
+const uint8_t*
+Jit::Compile(const Chip8::chip8_t &c8, uint16_t pc)
+{
+    // Measure the block
+    uint32_t count = 0;
+    uint32_t addr = pc;
+    bool isTerminated = false;
+    while (count < MAX_BLOCK_LENGTH && addr < CODE_SIZE - 1)
+    {
+        uint16_t opcode = c8.RAM[addr] << 8 | c8.RAM[addr + 1];
+        if (!IsCompilable(opcode)) break;
+
+        ++count;
+        addr += 2;
+
+        if (IsBlockEnd(opcode))
+        {
+            isTerminated = true;
+            break;
+        }
+    }
+
+    if (count == 0) return nullptr;
+
+    // Start over when the buffer is full
+    if (m_used + JIT_MAX_BLOCK_SIZE > JIT_BUFFER_SIZE) Clear();
+
+    uint8_t *entry = m_buffer + m_used;
+
+    // Leave if the budget can't cover the whole block
+    Emit({0x41, 0x81, 0xFC}); Emit32(count);            // cmp r12d, count
+    Emit({0x0F, 0x82}); uint8_t *noBudget = m_buffer + m_used; Emit32(0); // jb noBudget
+    Emit({0x41, 0x81, 0xEC}); Emit32(count);            // sub r12d, count
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint16_t at = pc + i * 2;
+        EmitInstruction(Chip8::instruction_t(c8.RAM[at] << 8 | c8.RAM[at + 1]), at + 2);
+    }
+
+    // Ran out of block: carry on with the next instruction
+    if (!isTerminated) EmitExit(addr);
+
+    Patch(noBudget, m_buffer + m_used);
+    Emit8(0xB8); Emit32(pc);                            // mov eax, pc
+    EmitJump(0, m_exit);
+
+    // Publish the block and link everything that was waiting for it
+    m_entries[pc] = entry;
+    for (uint8_t *site : m_links[pc]) Patch(site, entry);
+    m_links[pc].clear();
+
+    for (uint32_t i = pc; i < addr; ++i) m_code[i] = true;
+
+    return entry;
+}
+
+void
+Jit::EmitInstruction(const Chip8::instruction_t &instr, uint16_t next)
+{
+    if (Chip8::Decode(instr.OP, m_profile).function == nullptr) return;
+
+    const uint32_t VX = OFF_V(instr.X);
+    const uint32_t VY = OFF_V(instr.Y);
+    const uint32_t VF = OFF_V(0xF);
+
+    // Conditional skip on the flags just set; `noSkip` is the jcc taken when not skipping
+    auto skip = [&](uint8_t noSkip)
+    {
+        Emit({0x0F, noSkip}); uint8_t *site = m_buffer + m_used; Emit32(0);
+        EmitExit(next + 2);
+        Patch(site, m_buffer + m_used);
+        EmitExit(next);
+    };
+
+    switch ((instr.OP & 0xF000) >> 12)
+    {
+        case 0x0: // 00EE
+        {
+            Emit8(0xFE); EmitModRM(1, OFF_SP);                      // dec byte [SP]
+            Emit8(0x80); EmitModRM(4, OFF_SP); Emit8(STACK_SIZE - 1); // and byte [SP], 0x0F
+            Emit({0x0F, 0xB6}); EmitModRM(REG_EAX, OFF_SP);         // movzx eax, byte [SP]
+            Emit({0x0F, 0xB7, 0x84, 0x43}); Emit32(OFF_STACK);      // movzx eax, word [STACK + rax * 2]
+            EmitDynamicExit();
+            break;
+        }
+        case 0x1: EmitExit(instr.NNN); break;
+        case 0x2:
+        {
+            Emit({0x0F, 0xB6}); EmitModRM(REG_EAX, OFF_SP);         // movzx eax, byte [SP]
+            Emit({0x66, 0xC7, 0x84, 0x43}); Emit32(OFF_STACK); Emit16(next); // mov word [STACK + rax * 2], next
+            Emit({0xFF, 0xC0});                                     // inc eax
+            Emit({0x83, 0xE0, STACK_SIZE - 1});                     // and eax, 0x0F
+            Emit8(0x88); EmitModRM(REG_EAX, OFF_SP);                // mov [SP], al
+            EmitExit(instr.NNN);
+            break;
+        }
+        case 0x3:
+        {
+            Emit8(0x80); EmitModRM(7, VX); Emit8(instr.NN);         // cmp byte [Vx], NN
+            skip(0x85);                                             // jne
+            break;
+        }
+        case 0x4:
+        {
+            Emit8(0x80); EmitModRM(7, VX); Emit8(instr.NN);         // cmp byte [Vx], NN
+            skip(0x84);                                             // je
+            break;
+        }
+        case 0x6: Emit8(0xC6); EmitModRM(0, VX); Emit8(instr.NN); break; // mov byte [Vx], NN
+        case 0x7: Emit8(0x80); EmitModRM(0, VX); Emit8(instr.NN); break; // add byte [Vx], NN
+        case 0x8:
+        {
+            // Shifts of Vy into Vx
+            if (m_quirks.shift_uses_vy && (instr.N == 0x6 || instr.N == 0xE))
+            {
+                Emit8(0x8A); EmitModRM(REG_EAX, VY);                // mov al, [Vy]
+                Emit8(0x88); EmitModRM(REG_EAX, VX);                // mov [Vx], al
+            }
+
+            switch (instr.N)
+            {
+                case 0x0: Emit8(0x8A); EmitModRM(REG_EAX, VY); Emit8(0x88); EmitModRM(REG_EAX, VX); break; // Vx = Vy
+                case 0x1: Emit8(0x8A); EmitModRM(REG_EAX, VY); Emit8(0x08); EmitModRM(REG_EAX, VX); break; // Vx |= Vy
+                case 0x2: Emit8(0x8A); EmitModRM(REG_EAX, VY); Emit8(0x20); EmitModRM(REG_EAX, VX); break; // Vx &= Vy
+                case 0x3: Emit8(0x8A); EmitModRM(REG_EAX, VY); Emit8(0x30); EmitModRM(REG_EAX, VX); break; // Vx ^= Vy
+                case 0x4:
+                {
+                    Emit({0x0F, 0xB6}); EmitModRM(REG_EAX, VX);     // movzx eax, byte [Vx]
+                    Emit({0x0F, 0xB6}); EmitModRM(REG_ECX, VY);     // movzx ecx, byte [Vy]
+                    Emit({0x01, 0xC8});                             // add eax, ecx
+                    Emit8(0x3D); Emit32(0xFF);                      // cmp eax, 0xFF
+                    Emit({0x0F, 0x97, 0xC2});                       // seta dl
+                    Emit8(0x88); EmitModRM(REG_EDX, VF);            // mov [VF], dl
+                    Emit8(0x8A); EmitModRM(REG_EAX, VY);            // mov al, [Vy]
+                    Emit8(0x00); EmitModRM(REG_EAX, VX);            // add [Vx], al
+                    break;
+                }
+                case 0x5:
+                {
+                    Emit8(0x8A); EmitModRM(REG_EAX, VX);            // mov al, [Vx]
+                    Emit8(0x3A); EmitModRM(REG_EAX, VY);            // cmp al, [Vy]
+                    Emit({0x0F, 0x93, 0xC2});                       // setae dl
+                    Emit8(0x88); EmitModRM(REG_EDX, VF);            // mov [VF], dl
+                    Emit8(0x8A); EmitModRM(REG_EAX, VY);            // mov al, [Vy]
+                    Emit8(0x28); EmitModRM(REG_EAX, VX);            // sub [Vx], al
+                    break;
+                }
+                case 0x6:
+                {
+                    Emit8(0x8A); EmitModRM(REG_EAX, VX);            // mov al, [Vx]
+                    Emit({0x24, 0x01});                             // and al, 1
+                    Emit8(0x88); EmitModRM(REG_EAX, VF);            // mov [VF], al
+                    Emit8(0xD0); EmitModRM(5, VX);                  // shr byte [Vx], 1
+                    break;
+                }
+                case 0x7:
+                {
+                    Emit8(0x8A); EmitModRM(REG_EAX, VX);            // mov al, [Vx]
+                    Emit8(0x3A); EmitModRM(REG_EAX, VY);            // cmp al, [Vy]
+                    Emit({0x0F, 0x96, 0xC2});                       // setbe dl
+                    Emit8(0x88); EmitModRM(REG_EDX, VF);            // mov [VF], dl
+                    Emit8(0x8A); EmitModRM(REG_EAX, VY);            // mov al, [Vy]
+                    Emit8(0x2A); EmitModRM(REG_EAX, VX);            // sub al, [Vx]
+                    Emit8(0x88); EmitModRM(REG_EAX, VX);            // mov [Vx], al
+                    break;
+                }
+                case 0xE:
+                {
+                    Emit8(0x8A); EmitModRM(REG_EAX, VX);            // mov al, [Vx]
+                    Emit({0xC0, 0xE8, 0x07});                       // shr al, 7
+                    Emit8(0x88); EmitModRM(REG_EAX, VF);            // mov [VF], al
+                    Emit8(0xD0); EmitModRM(4, VX);                  // shl byte [Vx], 1
+                    break;
+                }
+                default: break;
+            }
+
+            // Logic ops clobbering VF
+            if (m_quirks.logic_resets_vf && instr.N >= 0x1 && instr.N <= 0x3)
+            {
+                Emit8(0xC6); EmitModRM(0, VF); Emit8(0x00);         // mov byte [VF], 0
+            }
+            break;
+        }
+        case 0x5:
+        {
+            Emit8(0x8A); EmitModRM(REG_EAX, VX);                    // mov al, [Vx]
+            Emit8(0x3A); EmitModRM(REG_EAX, VY);                    // cmp al, [Vy]
+            skip(0x85);                                             // jne
+            break;
+        }
+        case 0x9:
+        {
+            Emit8(0x8A); EmitModRM(REG_EAX, VX);                    // mov al, [Vx]
+            Emit8(0x3A); EmitModRM(REG_EAX, VY);                    // cmp al, [Vy]
+            skip(0x84);                                             // je
+            break;
+        }
+        case 0xA: Emit({0x41, 0xBD}); Emit32(instr.NNN); break;     // mov r13d, NNN
+        case 0xB:
+        {
+            uint32_t VJ = m_quirks.jump_uses_vx ? VX : OFF_V(0);
+            Emit({0x0F, 0xB6}); EmitModRM(REG_EAX, VJ);             // movzx eax, byte [V0] / [Vx]
+            Emit8(0x05); Emit32(instr.NNN);                         // add eax, NNN
+            Emit8(0x25); Emit32(PROG_END);                          // and eax, PROG_END
+            EmitDynamicExit();
+            break;
+        }
+        case 0xE:
+        {
+            Emit({0x0F, 0xB6}); EmitModRM(REG_EAX, VX);             // movzx eax, byte [Vx]
+            Emit({0x83, 0xE0, 0x0F});                               // and eax, 0x0F
+            Emit({0x0F, 0xB7}); EmitModRM(REG_ECX, OFF_KP);         // movzx ecx, word [KP]
+            Emit({0x0F, 0xA3, 0xC1});                               // bt ecx, eax
+            skip(instr.NN == 0x9E ? 0x83 : 0x82);                   // jnc (EX9E) / jc (EXA1)
+            break;
+        }
+        case 0xF:
+        {
+            if (instr.NN == 0x1E)
+            {
+                if (m_quirks.add_i_sets_vf)
+                {
+                    Emit({0x41, 0x0F, 0xB7, 0xC5});                 // movzx eax, r13w
+                    Emit({0x0F, 0xB6}); EmitModRM(REG_ECX, VX);     // movzx ecx, byte [Vx]
+                    Emit({0x01, 0xC8});                             // add eax, ecx
+                    Emit8(0x3D); Emit32(0xFFF);                     // cmp eax, 0xFFF
+                    Emit({0x0F, 0x97, 0xC2});                       // seta dl
+                    Emit8(0x88); EmitModRM(REG_EDX, VF);            // mov [VF], dl
+                }
+                Emit({0x0F, 0xB6}); EmitModRM(REG_ECX, VX);         // movzx ecx, byte [Vx]
+                Emit({0x66, 0x41, 0x01, 0xCD});                     // add r13w, cx
+            }
+            else // FX29
+            {
+                Emit({0x0F, 0xB6}); EmitModRM(REG_EAX, VX);         // movzx eax, byte [Vx]
+                Emit({0x44, 0x8D, 0x2C, 0x80});                     // lea r13d, [rax + rax * 4]
+            }
+            break;
+        }
+        default: break;
+    }
+}
+
+void
+Jit::EmitStubs()
+{
+    m_used = 0;
+
+    // uint32_t enter(chip8_t *c8 = rdi, uint32_t cycles = esi, const uint8_t *entry = rdx)
+    m_enter = (enter_t)(m_buffer + m_used);
+    Emit8(0x53);                                                    // push rbx
+    Emit({0x41, 0x54});                                             // push r12
+    Emit({0x41, 0x55});                                             // push r13
+    Emit({0x48, 0x89, 0xFB});                                       // mov rbx, rdi
+    Emit({0x41, 0x89, 0xF4});                                       // mov r12d, esi
+    Emit({0x44, 0x0F, 0xB7, 0xAB}); Emit32(OFF_I);                  // movzx r13d, word [I]
+    Emit({0xFF, 0xE2});                                             // jmp rdx
+
+    // Write back PC (eax) and I, return the cycles left
+    m_exit = m_buffer + m_used;
+    Emit({0x66, 0x89, 0x83}); Emit32(OFF_PC);                       // mov [PC], ax
+    Emit({0x66, 0x44, 0x89, 0xAB}); Emit32(OFF_I);                  // mov [I], r13w
+    Emit({0x44, 0x89, 0xE0});                                       // mov eax, r12d
+    Emit({0x41, 0x5D});                                             // pop r13
+    Emit({0x41, 0x5C});                                             // pop r12
+    Emit8(0x5B);                                                    // pop rbx
+    Emit8(0xC3);                                                    // ret
+
+    m_stubsSize = m_used;
+}
+
+void
+Jit::EmitExit(uint16_t pc)
+{
+    // Already compiled: chain straight into it
+    if (pc < CODE_SIZE && m_entries[pc] != m_exit)
+    {
+        EmitJump(0, m_entries[pc]);
+        return;
+    }
+
+    // Jump to the next instruction for now; patched once the target is compiled
+    Emit8(0xE9); uint8_t *site = m_buffer + m_used; Emit32(0);
+    if (pc < CODE_SIZE) m_links[pc].push_back(site);
+
+    Emit8(0xB8); Emit32(pc);                                        // mov eax, pc
+    EmitJump(0, m_exit);
+}
+
+void
+Jit::EmitDynamicExit()
+{
+    Emit8(0x3D); Emit32(CODE_SIZE);                                 // cmp eax, CODE_SIZE
+    EmitJump(0x83, m_exit);                                         // jae exit
+    Emit({0x48, 0xB9}); Emit64((uint64_t)m_entries.data());         // mov rcx, entries
+    Emit({0xFF, 0x24, 0xC1});                                       // jmp [rcx + rax * 8]
+}
+
+void
+Jit::Emit(std::initializer_list<uint8_t> bytes)
+{
+    for (uint8_t byte : bytes) Emit8(byte);
+}
+
+void
+Jit::Emit8(uint8_t value)
+{
+    m_buffer[m_used++] = value;
+}
+
+void
+Jit::Emit16(uint16_t value)
+{
+    memcpy(m_buffer + m_used, &value, sizeof(value));
+    m_used += sizeof(value);
+}
+
+void
+Jit::Emit32(uint32_t value)
+{
+    memcpy(m_buffer + m_used, &value, sizeof(value));
+    m_used += sizeof(value);
+}
+
+void
+Jit::Emit64(uint64_t value)
+{
+    memcpy(m_buffer + m_used, &value, sizeof(value));
+    m_used += sizeof(value);
+}
+
+void
+Jit::EmitModRM(uint8_t reg, uint32_t disp)
+{
+    Emit8(0x80 | (reg & 7) << 3 | 0x3); // mod = 10, rm = rbx
+    Emit32(disp);
+}
+
+void
+Jit::EmitJump(uint8_t opcode, const uint8_t *target)
+{
+    if (opcode == 0) Emit8(0xE9);
+    else Emit({0x0F, opcode});
+
+    uint8_t *site = m_buffer + m_used;
+    Emit32(0);
+    Patch(site, target);
+}
+
+void
+Jit::Patch(uint8_t *site, const uint8_t *target)
+{
+    // rel32 is relative to the end of the jump
+    int32_t rel = (int32_t)(target - (site + 4));
+    memcpy(site, &rel, sizeof(rel));
+}
@@ -0,0 +1,143 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_JIT_H
+#define CHIP0U_JIT_H
+
+#include <bitset>
+#include <vector>
+
+#include "Chip8.h"
+
+// Native code generation is only available for x86-64 System V hosts
+#if defined(__x86_64__) && defined(__unix__) && !defined(__EMSCRIPTEN__)
+#define CHIP0U_JIT 1
+#endif
+
+#define JIT_BUFFER_SIZE     (1024 * 1024)
+#define JIT_HOT_THRESHOLD   8
+
+
+// Translates hot CHIP-8 blocks into x86-64 code.
+//
+// Compiled code keeps a pointer to chip8_t in RBX, the cycle budget in R12D and I in R13W;
+// the PC is implied by the code being run and only written back on exit. Blocks jump straight
+// into each other once their targets are compiled, so a hot loop never leaves native code
+// until the budget runs out or an instruction that only the interpreter handles comes up
+// (draws, key waits, timers, random numbers and memory accesses).
+class Jit
+{
+public:
+    Jit();
+    ~Jit();
+
+    // Whether native code can be run on this host
+    bool IsAvailable() const;
+
+    // Run compiled code from the current PC, for at most `cycles` instructions.
+    // Returns the number of instructions executed; 0 means the interpreter has to take over
+    uint32_t Execute(Chip8::chip8_t &c8, uint32_t cycles);
+
+    // Drop the compiled code if anything in [addr, addr + size) was translated
+    void Invalidate(uint16_t addr, uint16_t size);
+
+    // Drop every compiled block
+    void Clear();
+
+    // Translate with the behaviour of another quirk profile, dropping every block
+    void SetProfile(Chip8::profile_t profile);
+
+private:
+    typedef uint32_t (*enter_t)(Chip8::chip8_t *c8, uint32_t cycles, const uint8_t *entry);
+
+    // Map the buffer and the tables on first use, so instances that never run native code don't pay for them
+    bool Reserve();
+
+    // Flip the buffer between writable, while a block is emitted and linked, and executable
+    bool SetWritable(bool isWritable);
+
+    // Whether an instruction can be translated, and whether it ends the block
+    [[nodiscard]] bool IsCompilable(uint16_t opcode) const;
+    [[nodiscard]] bool IsBlockEnd(uint16_t opcode) const;
+
+    const uint8_t* Compile(const Chip8::chip8_t &c8, uint16_t pc);
+    void EmitInstruction(const Chip8::instruction_t &instr, uint16_t next);
+    void EmitStubs();
+
+    // Leave the block towards a known address, chaining to it when compiled
+    void EmitExit(uint16_t pc);
+    // Leave the block towards the address held in EAX
+    void EmitDynamicExit();
+
+    // Raw emitters
+    void Emit(std::initializer_list<uint8_t> bytes);
+    void Emit8(uint8_t value);
+    void Emit16(uint16_t value);
+    void Emit32(uint32_t value);
+    void Emit64(uint64_t value);
+    void EmitModRM(uint8_t reg, uint32_t disp);  // [rbx + disp32]
+    void EmitJump(uint8_t opcode, const uint8_t *target); // jmp/jcc rel32, opcode 0 for jmp
+    void Patch(uint8_t *site, const uint8_t *target);
+
+private:
+    // Quirks the generated code follows
+    Chip8::profile_t m_profile {Chip8::profile_t::Chip0u};
+    quirks_t         m_quirks {Chip0uQuirks::value};
+
+    // Code buffer, executable but not writable except while Compile() runs
+    uint8_t *m_buffer {nullptr};
+    bool     m_hasFailed {false};
+    size_t   m_used {0};
+    size_t   m_stubsSize {0};
+
+    // Shared entry trampoline and exit stub
+    enter_t        m_enter {nullptr};
+    const uint8_t *m_exit {nullptr};
+
+    // Entry point of each address; the exit stub if not compiled.
+    // Read by the generated code for returns and computed jumps
+    std::vector<const uint8_t*> m_entries;
+
+    // Jumps waiting for their target to be compiled
+    std::vector<std::vector<uint8_t*>> m_links;
+
+    // Times an address was asked for before being compiled
+    std::vector<uint8_t> m_hits;
+
+    // Addresses whose first instruction can't be translated
+    std::bitset<CODE_SIZE> m_rejected;
+
+    // Bytes covered by translated instructions
+    std::bitset<CODE_SIZE> m_code;
+};
+
+inline bool
+Jit::IsAvailable() const
+{
+#if defined(CHIP0U_JIT)
+    return !m_hasFailed;
+#else
+    return false;
+#endif
+}
+
+#endif //CHIP0U_JIT_H
@@ -0,0 +1,69 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_QUIRKS_H
+#define CHIP0U_QUIRKS_H
+
+// Behaviours that differ between CHIP-8 interpreters
+typedef struct quirks_t
+{
+    const char* name;
+
+    bool shift_uses_vy;     // 8XY6/8XYE shift Vy into Vx, instead of shifting Vx in place
+    bool memory_moves_i;    // FX55/FX65 leave I = I + X + 1
+    bool jump_uses_vx;      // BXNN jumps to XNN + Vx, instead of NNN + V0
+    bool add_i_sets_vf;     // FX1E sets VF when I goes past 0xFFF
+    bool logic_resets_vf;   // 8XY1/8XY2/8XY3 reset VF
+    bool super_chip;        // SUPER-CHIP instructions: 128x64 display, scrolling, big font and flag registers
+    bool xo_chip;           // XO-CHIP instructions: F000 NNNN long loads, bitplanes, audio, 5XY2/5XY3 and 00DN
+    bool wrap_sprites;      // DXYN wraps pixels past an edge around to the other side, instead of clipping them
+} quirks_t;
+
+
+// Quirk policies. Instructions are templated on them, so every profile gets its own
+// handlers with the choices folded in at compile time
+
+// What Chip0u always did
+struct Chip0uQuirks
+{
+    static constexpr quirks_t value { "Chip0u", false, true, false, true, false, false, false, false };
+};
+
+// COSMAC VIP interpreter
+struct Chip8Quirks
+{
+    static constexpr quirks_t value { "CHIP-8", true, true, false, false, true, false, false, false };
+};
+
+// SUPER-CHIP 1.1
+struct SuperChipQuirks
+{
+    static constexpr quirks_t value { "SUPER-CHIP", false, false, true, false, false, true, false, false };
+};
+
+// XO-CHIP
+struct XoChipQuirks
+{
+    static constexpr quirks_t value { "XO-CHIP", true, true, false, false, false, true, true, true };
+};
+
+#endif //CHIP0U_QUIRKS_H
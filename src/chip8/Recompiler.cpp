@@ -0,0 +1,385 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Recompiler.h"
+
+#include "Aot.h"
+#include "CodeCache.h"
+
+#include <cstdarg>
+#include <vector>
+
+
+static std::string
+Format(const char* format, ...)
+{
+    char buffer[256];
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    return buffer;
+}
+
+// Skips are the only instructions with two successors
+static bool
+IsSkip(uint16_t opcode)
+{
+    switch ((opcode & 0xF000) >> 12)
+    {
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9: return true;
+        case 0xE: return (opcode & 0x00FF) == 0x9E || (opcode & 0x00FF) == 0xA1;
+        default: return false;
+    }
+}
+
+// Instructions that leave the block
+static bool
+IsControl(uint16_t opcode)
+{
+    return opcode == 0x00EE || (opcode & 0xF000) == 0x1000 || (opcode & 0xF000) == 0x2000 || IsSkip(opcode);
+}
+
+
+Recompiler::Recompiler(const uint8_t* ram, uint16_t romSize, Chip8::profile_t profile,
+                       const std::map<uint16_t, std::string>& disassembly)
+    : m_ram(ram)
+    , m_romSize(romSize)
+    , m_profile(profile)
+    , m_quirks(Chip8::GetQuirks(profile))
+    , m_disassembly(disassembly)
+{
+}
+
+
+
+std::string
+Recompiler::Translate()
+{
+    Discover();
+
+    // Every reached leader the interpreter doesn't have to run gets a function
+    m_blocks.reset();
+    for (uint32_t addr = 0; addr < CODE_SIZE; ++addr)
+    {
+        if (m_leaders[addr] && m_reached[addr] && !IsInterpreted(Fetch(addr))) m_blocks[addr] = true;
+    }
+
+    std::string out;
+    out += "// Chip0u AOT module, written by Chip0uAot. Do not edit.\n";
+    out += Format("// Quirk profile: %s\n", m_quirks.name);
+    out += "// Build: c++ -std=c++20 -O2 -shared -fPIC -I<Chip0u>/src <this file> -o <module>.so\n\n";
+    out += "#include \"chip8/Aot.h\"\n\n";
+
+    // Blocks are labels of a single function and go to each other, rather than call each other in
+    // tail position, which the compiler is free not to turn into a jump: the stack stays flat
+    // whatever the budget. Computed targets go round the loop, through the switch
+    std::string labels;
+    std::vector<std::pair<uint16_t, uint32_t>> blocks;
+    for (uint32_t addr = 0; addr < CODE_SIZE; ++addr)
+    {
+        if (!m_blocks[addr]) continue;
+
+        uint32_t length = 0;
+        std::string body = TranslateBlock(addr, length);
+        blocks.emplace_back(addr, length);
+
+        labels += Format("\nb%03X:\n", addr);
+        labels += Format("    if (budget < %u) { pc = 0x%03X; goto out; }\n", length, addr);
+        labels += Format("    budget -= %u;\n\n", length);
+        labels += body;
+    }
+    for (size_t i = 0; i < labels.size(); i = labels.find('\n', i) + 1)
+    {
+        if (labels[i] != '\n') labels.insert(i, "    ");
+    }
+
+    out += "static uint32_t\n";
+    out += "Run(Chip8::chip8_t *c8, uint32_t budget, const uint8_t *valid)\n";
+    out += "{\n";
+    out += "    uint16_t pc = c8->PC;\n";
+    out += "    while (pc < CODE_SIZE && valid[pc])\n";
+    out += "    {\n";
+    out += "        switch (pc)\n";
+    out += "        {\n";
+    for (const auto &[addr, length] : blocks) out += Format("            case 0x%03X: goto b%03X;\n", addr, addr);
+    out += "            default: goto out;\n";
+    out += "        }\n";
+    out += labels;
+    out += "    }\n\n";
+    out += "out:\n";
+    out += "    c8->PC = pc;\n";
+    out += "    return budget;\n";
+    out += "}\n";
+
+    // Module description
+    out += "\nstatic const aot_block_info_t s_blocks[] =\n{\n";
+    for (const auto &[addr, length] : blocks) out += Format("    {0x%03X, %u},\n", addr, length);
+    if (blocks.empty()) out += "    {0, 0},\n";
+    out += "};\n\n";
+
+    out += "static const uint8_t s_image[] =\n{";
+    for (uint32_t i = 0; i < m_romSize; ++i)
+    {
+        out += Format(i % 16 == 0 ? "\n    0x%02X," : " 0x%02X,", m_ram[PROG_START + i]);
+    }
+    if (m_romSize == 0) out += "\n    0x00,";
+    out += "\n};\n\n";
+
+    out += "static const aot_module_t s_module =\n{\n";
+    out += "    AOT_ABI_VERSION,\n";
+    out += "    sizeof(Chip8::chip8_t),\n";
+    out += Format("    %u,\n", (uint32_t)m_profile);
+    out += Format("    0x%03X, %u, s_image,\n", PROG_START, m_romSize);
+    out += Format("    s_blocks, %u,\n", (uint32_t)blocks.size());
+    out += "    Run\n";
+    out += "};\n\n";
+
+    out += "extern \"C\" const aot_module_t*\n";
+    out += AOT_MODULE_SYMBOL "()\n";
+    out += "{\n";
+    out += "    return &s_module;\n";
+    out += "}\n";
+
+    return out;
+}
+
+bool
+Recompiler::IsInterpreted(uint16_t opcode) const
+{
+    // XO-CHIP skips step over the four bytes of F000 NNNN, and 5XY2/5XY3 move registers
+    if (m_quirks.xo_chip && IsSkip(opcode)) return true;
+
+    uint8_t nn = opcode & 0x00FF;
+    switch ((opcode & 0xF000) >> 12)
+    {
+        case 0x0: return opcode != 0x00EE;                          // Display, scrolls and modes
+        case 0xB:                                                   // Computed jump
+        case 0xC:                                                   // Random numbers
+        case 0xD: return true;                                      // Display
+        case 0xF: return nn != 0x1E && nn != 0x29 && nn != 0x65;   // Timers, keys and memory writes
+        default: return false;
+    }
+}
+
+void
+Recompiler::Discover()
+{
+    m_reached.reset();
+    m_leaders.reset();
+
+    std::vector<uint16_t> pending;
+    auto reach = [&](uint32_t addr, bool isLeader)
+    {
+        if (!IsInRom(addr)) return;
+
+        if (isLeader) m_leaders[addr] = true;
+        if (!m_reached[addr])
+        {
+            m_reached[addr] = true;
+            pending.push_back(addr);
+        }
+    };
+
+    reach(PROG_START, true);
+    while (!pending.empty())
+    {
+        uint16_t addr = pending.back();
+        pending.pop_back();
+
+        Chip8::instruction_t instr(Fetch(addr));
+        if (IsInterpreted(instr.OP))
+        {
+            // The interpreter hands back at the next instruction, except for BNNN which goes anywhere
+            if ((instr.OP & 0xF000) == 0xB000) continue;
+
+            // F000 NNNN is four bytes long, and so is what an XO-CHIP skip steps over
+            uint16_t next = instr.OP == 0xF000 ? addr + 4 : addr + 2;
+            reach(next, true);
+            if (IsSkip(instr.OP)) reach(IsInRom(next) && Fetch(next) == 0xF000 ? next + 4 : next + 2, true);
+        }
+        else if (IsSkip(instr.OP))
+        {
+            reach(addr + 2, true);
+            reach(addr + 4, true);
+        }
+        else if ((instr.OP & 0xF000) == 0x1000)
+        {
+            reach(instr.NNN, true);
+        }
+        else if ((instr.OP & 0xF000) == 0x2000)
+        {
+            reach(instr.NNN, true);
+            reach(addr + 2, true);  // Where the subroutine returns to
+        }
+        else if (instr.OP != 0x00EE)
+        {
+            reach(addr + 2, false);
+        }
+    }
+}
+
+std::string
+Recompiler::TranslateBlock(uint16_t start, uint32_t &length)
+{
+    std::string body;
+
+    length = 0;
+    uint32_t addr = start;
+    while (true)
+    {
+        Chip8::instruction_t instr(Fetch(addr));
+        ++length;
+
+        auto line = m_disassembly.find(addr);
+        body += line != m_disassembly.end() ? "    // " + line->second + "\n" : Format("    // $%04X: %04X\n", addr, instr.OP);
+        body += TranslateInstruction(instr, addr);
+
+        // Control flow leaves on its own
+        if (IsControl(instr.OP)) break;
+
+        addr += 2;
+        if (!IsInRom(addr) || IsInterpreted(Fetch(addr)) || m_leaders[addr] || length == MAX_BLOCK_LENGTH)
+        {
+            body += Jump(addr);
+            break;
+        }
+    }
+
+    return body;
+}
+
+std::string
+Recompiler::TranslateInstruction(const Chip8::instruction_t &instr, uint16_t addr)
+{
+    const uint8_t X = instr.X;
+    const uint8_t Y = instr.Y;
+
+    // Unknown opcodes do nothing
+    if (Chip8::Decode(instr.OP, m_profile).function == nullptr) return "";
+
+    // Skips continue past the next instruction when the condition holds
+    auto skip = [&](const std::string &condition)
+    {
+        std::string taken = Jump(addr + 4);
+        for (size_t i = 0; i < taken.size(); i = taken.find('\n', i) + 1) taken.insert(i, "    ");
+
+        return "    if (" + condition + ")\n    {\n" + taken + "    }\n" + Jump(addr + 2);
+    };
+
+    switch ((instr.OP & 0xF000) >> 12)
+    {
+        case 0x0: return "    c8->SP = (c8->SP - 1) & (STACK_SIZE - 1);\n    pc = c8->STACK[c8->SP];\n    continue;\n";
+        case 0x1: return Jump(instr.NNN);
+        case 0x2: return Format("    c8->STACK[c8->SP] = 0x%03X;\n    c8->SP = (c8->SP + 1) & (STACK_SIZE - 1);\n", addr + 2) + Jump(instr.NNN);
+        case 0x3: return skip(Format("c8->V[0x%X] == 0x%02X", X, instr.NN));
+        case 0x4: return skip(Format("c8->V[0x%X] != 0x%02X", X, instr.NN));
+        case 0x5: return skip(Format("c8->V[0x%X] == c8->V[0x%X]", X, Y));
+        case 0x6: return Format("    c8->V[0x%X] = 0x%02X;\n", X, instr.NN);
+        case 0x7: return Format("    c8->V[0x%X] += 0x%02X;\n", X, instr.NN);
+        case 0x8:
+        {
+            std::string code;
+            switch (instr.N)
+            {
+                case 0x0: return Format("    c8->V[0x%X] = c8->V[0x%X];\n", X, Y);
+                case 0x1: code = Format("    c8->V[0x%X] |= c8->V[0x%X];\n", X, Y); break;
+                case 0x2: code = Format("    c8->V[0x%X] &= c8->V[0x%X];\n", X, Y); break;
+                case 0x3: code = Format("    c8->V[0x%X] ^= c8->V[0x%X];\n", X, Y); break;
+                case 0x4:
+                    return Format("    c8->V[0xF] = c8->V[0x%X] > (0xFF - c8->V[0x%X]) ? 1 : 0;\n", Y, X)
+                         + Format("    c8->V[0x%X] += c8->V[0x%X];\n", X, Y);
+                case 0x5:
+                    return Format("    c8->V[0xF] = c8->V[0x%X] > c8->V[0x%X] ? 0 : 1;\n", Y, X)
+                         + Format("    c8->V[0x%X] -= c8->V[0x%X];\n", X, Y);
+                case 0x6:
+                    if (m_quirks.shift_uses_vy) code = Format("    c8->V[0x%X] = c8->V[0x%X];\n", X, Y);
+                    return code + Format("    c8->V[0xF] = c8->V[0x%X] & 0x1;\n", X)
+                                + Format("    c8->V[0x%X] >>= 1;\n", X);
+                case 0x7:
+                    return Format("    c8->V[0xF] = c8->V[0x%X] > c8->V[0x%X] ? 0 : 1;\n", X, Y)
+                         + Format("    c8->V[0x%X] = c8->V[0x%X] - c8->V[0x%X];\n", X, Y, X);
+                case 0xE:
+                    if (m_quirks.shift_uses_vy) code = Format("    c8->V[0x%X] = c8->V[0x%X];\n", X, Y);
+                    return code + Format("    c8->V[0xF] = c8->V[0x%X] >> 7;\n", X)
+                                + Format("    c8->V[0x%X] <<= 1;\n", X);
+                default: return "";
+            }
+
+            // Logic ops
+            if (m_quirks.logic_resets_vf) code += "    c8->V[0xF] = 0;\n";
+            return code;
+        }
+        case 0x9: return skip(Format("c8->V[0x%X] != c8->V[0x%X]", X, Y));
+        case 0xA: return Format("    c8->I = 0x%03X;\n", instr.NNN);
+        case 0xE:
+        {
+            const char* compare = instr.NN == 0x9E ? "!=" : "==";
+            return skip(Format("(c8->KP >> (c8->V[0x%X] & 0xF) & 1) %s 0", X, compare));
+        }
+        case 0xF:
+        {
+            if (instr.NN == 0x1E)
+            {
+                std::string code;
+                if (m_quirks.add_i_sets_vf) code = Format("    c8->V[0xF] = (c8->I + c8->V[0x%X] > 0xFFF) ? 1 : 0;\n", X);
+                return code + Format("    c8->I += c8->V[0x%X];\n", X);
+            }
+            if (instr.NN == 0x29) return Format("    c8->I = c8->V[0x%X] * 0x5;\n", X);
+
+            // FX65
+            std::string code = Format("    for (int i = 0; i <= 0x%X; ++i) c8->V[i] = c8->RAM[(c8->I + i) % TOTAL_RAM];\n", X);
+            if (m_quirks.memory_moves_i) code += Format("    c8->I += 0x%X;\n", X + 1);
+            return code;
+        }
+        default: return "";
+    }
+}
+
+std::string
+Recompiler::Jump(uint16_t addr) const
+{
+    if (addr < CODE_SIZE && m_blocks[addr])
+    {
+        return Format("    if (valid[0x%03X]) goto b%03X;\n    pc = 0x%03X;\n    goto out;\n", addr, addr, addr);
+    }
+
+    return Format("    pc = 0x%03X;\n    goto out;\n", addr);
+}
+
+bool
+Recompiler::IsInRom(uint32_t addr) const
+{
+    const uint32_t end = (uint32_t)PROG_START + m_romSize;
+    return addr >= PROG_START && addr + 1 < end && addr + 1 < CODE_SIZE;
+}
+
+uint16_t
+Recompiler::Fetch(uint16_t addr) const
+{
+    return m_ram[addr] << 8 | m_ram[addr + 1];
+}
@@ -0,0 +1,87 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_RECOMPILER_H
+#define CHIP0U_RECOMPILER_H
+
+#include <bitset>
+#include <map>
+#include <string>
+
+#include "Chip8.h"
+
+
+// Translates a ROM ahead of time into the C++ source of an AOT module (see Aot.h).
+//
+// Code is found by following every jump, call and skip from PROG_START. Each basic block becomes
+// a label of the module's one function; whatever only the interpreter handles (draws, key waits, timers, random numbers,
+// memory writes and BNNN) ends the block and is left to the interpreter, like any code that can't
+// be reached statically.
+class Recompiler
+{
+public:
+    // `ram` holds the ROM at PROG_START, `disassembly` is what Chip8::GetDisassembled() gives for it
+    Recompiler(const uint8_t* ram, uint16_t romSize, Chip8::profile_t profile,
+               const std::map<uint16_t, std::string>& disassembly);
+
+    // Source of the module
+    std::string Translate();
+
+    // Blocks written by the last Translate()
+    uint32_t GetBlockCount() const;
+
+    // Whether the interpreter has to run an instruction
+    [[nodiscard]] bool IsInterpreted(uint16_t opcode) const;
+
+private:
+    void Discover();
+    std::string TranslateBlock(uint16_t start, uint32_t &length);
+    std::string TranslateInstruction(const Chip8::instruction_t &instr, uint16_t addr);
+
+    // Statements leaving the block towards a known address
+    std::string Jump(uint16_t addr) const;
+
+    [[nodiscard]] bool IsInRom(uint32_t addr) const;
+    [[nodiscard]] uint16_t Fetch(uint16_t addr) const;
+
+private:
+    const uint8_t* m_ram {nullptr};
+    uint16_t m_romSize {0};
+    Chip8::profile_t m_profile {Chip8::profile_t::Chip0u};
+    quirks_t m_quirks {Chip0uQuirks::value};
+    std::map<uint16_t, std::string> m_disassembly;
+
+    // Addresses reached by the control flow, and those a block starts at
+    std::bitset<CODE_SIZE> m_reached;
+    std::bitset<CODE_SIZE> m_leaders;
+
+    // Addresses with a block
+    std::bitset<CODE_SIZE> m_blocks;
+};
+
+inline uint32_t
+Recompiler::GetBlockCount() const
+{
+    return m_blocks.count();
+}
+
+#endif //CHIP0U_RECOMPILER_H
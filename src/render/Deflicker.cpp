@@ -0,0 +1,110 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "Deflicker.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+
+void
+Deflicker::Configure(mode_t mode, uint32_t frames)
+{
+    m_mode = mode;
+    m_frames = std::clamp<uint32_t>(frames, 2, DEFLICKER_FRAMES);
+    m_width = m_height = 0;
+}
+
+uint64_t
+Deflicker::Push(const Chip8::frame_t &frame)
+{
+    const uint64_t dirty = Chip8::GetDirtyRows(frame, m_generation);
+
+    // New settings, or the other resolution, start over from this frame alone
+    if (frame.width != m_width || frame.height != m_height)
+    {
+        m_width = frame.width;
+        m_height = frame.height;
+
+        memcpy(m_output, frame.state.DP, sizeof(m_output));
+        for (auto &planes : m_history) memcpy(planes, m_output, sizeof(planes));
+        std::fill(std::begin(m_rows), std::end(m_rows), 0);
+
+        m_changedRows = ~0ull >> (64 - m_height);
+        return m_changedRows;
+    }
+
+    // Rows that differ anywhere in the window changed in one of its frames; the others blend to what
+    // they already were. The slot taken is the oldest frame, which differs from this one on those rows only
+    ++m_count;
+    m_rows[m_count % m_frames] = dirty;
+
+    uint64_t rows = 0;
+    for (uint32_t k = 0; k < m_frames; ++k) rows |= m_rows[k];
+    rows &= ~0ull >> (64 - m_height);
+
+    planes_t &newest = m_history[m_count % m_frames];
+    const uint32_t words = m_width / 64;
+    const bool isMajority = m_mode == mode_t::Majority && m_frames > 2;
+
+    m_changedRows = 0;
+    for (; rows != 0; rows &= rows - 1)
+    {
+        const uint32_t y = std::countr_zero(rows);
+        for (uint32_t plane = 0; plane < PLANE_COUNT; ++plane)
+        {
+            for (uint32_t w = 0; w < words; ++w)
+            {
+                newest[plane][y][w] = frame.state.DP[plane][y][w];
+
+                // Pixels lit at least once, and at least twice; half of 3 or 4 frames is 2
+                uint64_t once = 0, twice = 0;
+                for (uint32_t k = 0; k < m_frames; ++k)
+                {
+                    const uint64_t word = m_history[k][plane][y][w];
+                    twice |= once & word;
+                    once |= word;
+                }
+
+                const uint64_t blend = isMajority ? twice : once;
+                m_changedRows |= (uint64_t)(blend != m_output[plane][y][w]) << y;
+                m_output[plane][y][w] = blend;
+            }
+        }
+    }
+
+    return m_changedRows;
+}
+
+const char*
+Deflicker::GetModeName(mode_t mode)
+{
+    switch (mode)
+    {
+        case mode_t::Off:      return "Off";
+        case mode_t::Any:      return "Any";
+        case mode_t::Majority: return "Majority";
+        default:               return "Unknown";
+    }
+}
@@ -0,0 +1,126 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef CHIP0U_DEFLICKER_H
+#define CHIP0U_DEFLICKER_H
+
+#include "chip8/Chip8.h"
+
+// Most frames blended
+#define DEFLICKER_FRAMES 4
+
+
+// Hides the flicker of sprites erased and drawn again with XOR, by showing what the display had lit
+// over the last few frames rather than in the last one alone.
+//
+// Works on the packed display, a word of 64 pixels at a time, and only on the rows that changed
+// within those frames; a frame where nothing moved costs next to nothing.
+class Deflicker
+{
+public:
+    enum class mode_t : uint8_t
+    {
+        Off,            // The display as it is
+        Any,            // Lit in any of the frames
+        Majority,       // Lit in at least half of them
+
+        Count
+    };
+
+public:
+    // Blend the last `frames` frames through `mode`, starting over from the next one pushed
+    void Configure(mode_t mode, uint32_t frames);
+
+    // Take the display of `frame` as the newest one. Returns the rows of the blend that changed,
+    // also kept for GetChangedRows()
+    uint64_t Push(const Chip8::frame_t &frame);
+
+    // The blend, laid out as chip8_t::DP
+    const uint64_t* GetDisplay(uint32_t plane = 0) const;
+    uint32_t GetWidth() const;
+    uint32_t GetHeight() const;
+    uint64_t GetChangedRows() const;
+
+    mode_t GetMode() const;
+    uint32_t GetFrames() const;
+
+    static const char* GetModeName(mode_t mode);
+
+private:
+    typedef uint64_t planes_t[PLANE_COUNT][DISPLAY_HEIGHT][DISPLAY_WORDS];
+
+    mode_t   m_mode {mode_t::Off};
+    uint32_t m_frames {2};
+
+    // Size of the frames; 0 until the first one, after which a change starts over
+    uint32_t m_width {0}, m_height {0};
+
+    // The last m_frames frames and the rows changed in each, in rings indexed by the frame count
+    planes_t m_history[DEFLICKER_FRAMES] {};
+    uint64_t m_rows[DEFLICKER_FRAMES] {};
+    uint64_t m_count {0};
+
+    // Display generation of the last frame pushed
+    uint64_t m_generation {0};
+
+    planes_t m_output {};
+    uint64_t m_changedRows {0};
+};
+
+inline const uint64_t*
+Deflicker::GetDisplay(uint32_t plane) const
+{
+    return &m_output[plane][0][0];
+}
+
+inline uint32_t
+Deflicker::GetWidth() const
+{
+    return m_width;
+}
+
+inline uint32_t
+Deflicker::GetHeight() const
+{
+    return m_height;
+}
+
+inline uint64_t
+Deflicker::GetChangedRows() const
+{
+    return m_changedRows;
+}
+
+inline Deflicker::mode_t
+Deflicker::GetMode() const
+{
+    return m_mode;
+}
+
+inline uint32_t
+Deflicker::GetFrames() const
+{
+    return m_frames;
+}
+
+#endif //CHIP0U_DEFLICKER_H
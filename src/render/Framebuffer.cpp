@@ -0,0 +1,290 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Framebuffer.h"
+
+#include <bit>
+#include <cmath>
+
+#if defined(CHIP0U_FADE_AVX2)
+#include <immintrin.h>
+#elif defined(CHIP0U_FADE_SSE2)
+#include <emmintrin.h>
+#endif
+
+
+void
+Framebuffer::Reset(rgba_t color)
+{
+    for (auto &pixel : m_pixels) pixel = color;
+    m_fadingRows = ~0ull;
+}
+
+void
+Framebuffer::Refade()
+{
+    m_fadingRows = ~0ull;
+}
+
+bool
+Framebuffer::Compose(const Chip8::frame_t &frame, const palette_t &palette, float halfLife, float deltaTime)
+{
+    return Compose(&frame.state.DP[0][0][0], &frame.state.DP[1][0][0], frame.width, frame.height,
+                   Chip8::GetDirtyRows(frame, m_generation), palette, halfLife, deltaTime);
+}
+
+bool
+Framebuffer::Compose(const Deflicker &deflicker, const palette_t &palette, float halfLife, float deltaTime)
+{
+    return Compose(deflicker.GetDisplay(), deflicker.GetDisplay(1), deflicker.GetWidth(), deflicker.GetHeight(),
+                   deflicker.GetChangedRows(), palette, halfLife, deltaTime);
+}
+
+bool
+Framebuffer::Compose(const uint64_t* display, const uint64_t* display2, uint32_t width, uint32_t height,
+                     uint64_t changedRows, const palette_t &palette, float halfLife, float deltaTime)
+{
+    // Rows that changed since the last frame start fading towards their new colors
+    m_fadingRows |= changedRows;
+
+    // The pixels of the other resolution mean nothing in this one
+    if (width != m_width)
+    {
+        m_width = width;
+        m_height = height;
+        Reset(palette.bg);
+    }
+
+    m_fadingRows &= ~0ull >> (64 - m_height);
+    if (m_fadingRows == 0) return false;
+
+    const uint32_t words = m_width / 64;
+    const float t = 1.0F - exp2f(-deltaTime / halfLife);
+
+    bool isChanged = false;
+    for (uint64_t rows = m_fadingRows; rows != 0; rows &= rows - 1)
+    {
+        const uint32_t y = std::countr_zero(rows);
+
+        bool isFading = false;
+        for (uint32_t w = 0; w < words; ++w)
+        {
+            bool isWordFading = false;
+            const uint32_t word = y * DISPLAY_WORDS + w;
+            isChanged |= FadeRow(m_pixels + y * m_width + w * 64, display[word], display2[word], palette, t, isWordFading);
+            isFading |= isWordFading;
+        }
+
+        if (!isFading) m_fadingRows &= ~(1ull << y);
+    }
+
+    return isChanged;
+}
+
+bool
+Framebuffer::FadeRowScalar(rgba_t* pixels, uint64_t bits, uint64_t bits2, const palette_t &palette, float t, bool &isFading)
+{
+    bool isChanged = false;
+    isFading = false;
+
+    for (uint32_t x = 0; x < 64; ++x)
+    {
+        const rgba_t current = pixels[x];
+        const bool isOn = (bits >> (63 - x)) & 1, isOn2 = (bits2 >> (63 - x)) & 1;
+        const rgba_t target = isOn2 ? (isOn ? palette.blend : palette.fg2) : (isOn ? palette.fg : palette.bg);
+        if (IsSameColor(current, target)) continue;
+
+        const rgba_t next =
+        {
+            (uint8_t) (current.r + (target.r - current.r) * t),
+            (uint8_t) (current.g + (target.g - current.g) * t),
+            (uint8_t) (current.b + (target.b - current.b) * t),
+            (uint8_t) (current.a + (target.a - current.a) * t)
+        };
+
+        // Settle on the target once the steps round down to nothing
+        pixels[x] = IsSameColor(next, current) ? target : next;
+        isFading |= !IsSameColor(pixels[x], target);
+        isChanged = true;
+    }
+
+    return isChanged;
+}
+
+#if defined(CHIP0U_FADE_AVX2)
+
+// 8 pixels at a time. The unpacks and packs work within 128-bit lanes, so they undo each other and
+// the pixels keep their order; the math is the scalar one, a multiply then an add, truncated
+bool
+Framebuffer::FadeRow(rgba_t* pixels, uint64_t bits, uint64_t bits2, const palette_t &palette, float t, bool &isFading)
+{
+    uint32_t fg, bg, fg2, blend;
+    memcpy(&fg, &palette.fg, sizeof(fg));
+    memcpy(&bg, &palette.bg, sizeof(bg));
+    memcpy(&fg2, &palette.fg2, sizeof(fg2));
+    memcpy(&blend, &palette.blend, sizeof(blend));
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i fgs = _mm256_set1_epi32((int)fg);
+    const __m256i bgs = _mm256_set1_epi32((int)bg);
+    const __m256i fg2s = _mm256_set1_epi32((int)fg2);
+    const __m256i blends = _mm256_set1_epi32((int)blend);
+    const __m256i lanes = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256 ts = _mm256_set1_ps(t);
+
+    auto lerp = [&](__m256i current, __m256i target)
+    {
+        __m256 difference = _mm256_cvtepi32_ps(_mm256_sub_epi32(target, current));
+        return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_cvtepi32_ps(current), _mm256_mul_ps(difference, ts)));
+    };
+
+    __m256i changed = zero, fading = zero;
+    for (uint32_t x = 0; x < 64; x += 8)
+    {
+        __m256i* address = (__m256i*)(pixels + x);
+        const __m256i current = _mm256_loadu_si256(address);
+
+        // Lanes take the color of the planes they're lit in
+        const __m256i byte = _mm256_set1_epi32((int)((bits >> (56 - x)) & 0xFF));
+        const __m256i byte2 = _mm256_set1_epi32((int)((bits2 >> (56 - x)) & 0xFF));
+        const __m256i isOn = _mm256_cmpeq_epi32(_mm256_and_si256(byte, lanes), lanes);
+        const __m256i isOn2 = _mm256_cmpeq_epi32(_mm256_and_si256(byte2, lanes), lanes);
+        const __m256i target = _mm256_blendv_epi8(_mm256_blendv_epi8(bgs, fgs, isOn), _mm256_blendv_epi8(fg2s, blends, isOn), isOn2);
+
+        const __m256i current16[2] = { _mm256_unpacklo_epi8(current, zero), _mm256_unpackhi_epi8(current, zero) };
+        const __m256i target16[2] = { _mm256_unpacklo_epi8(target, zero), _mm256_unpackhi_epi8(target, zero) };
+
+        __m256i next16[2];
+        for (int i = 0; i < 2; ++i)
+        {
+            __m256i low = lerp(_mm256_unpacklo_epi16(current16[i], zero), _mm256_unpacklo_epi16(target16[i], zero));
+            __m256i high = lerp(_mm256_unpackhi_epi16(current16[i], zero), _mm256_unpackhi_epi16(target16[i], zero));
+            next16[i] = _mm256_packs_epi32(low, high);
+        }
+        __m256i next = _mm256_packus_epi16(next16[0], next16[1]);
+
+        // Settle on the target once the steps round down to nothing
+        next = _mm256_blendv_epi8(next, target, _mm256_cmpeq_epi32(next, current));
+        _mm256_storeu_si256(address, next);
+
+        changed = _mm256_or_si256(changed, _mm256_xor_si256(next, current));
+        fading = _mm256_or_si256(fading, _mm256_xor_si256(next, target));
+    }
+
+    isFading = !_mm256_testz_si256(fading, fading);
+    return !_mm256_testz_si256(changed, changed);
+}
+
+const char*
+Framebuffer::GetKernelName()
+{
+    return "AVX2";
+}
+
+#elif defined(CHIP0U_FADE_SSE2)
+
+// 4 pixels at a time; the math is the scalar one, a multiply then an add, truncated
+bool
+Framebuffer::FadeRow(rgba_t* pixels, uint64_t bits, uint64_t bits2, const palette_t &palette, float t, bool &isFading)
+{
+    uint32_t fg, bg, fg2, blend;
+    memcpy(&fg, &palette.fg, sizeof(fg));
+    memcpy(&bg, &palette.bg, sizeof(bg));
+    memcpy(&fg2, &palette.fg2, sizeof(fg2));
+    memcpy(&blend, &palette.blend, sizeof(blend));
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i fgs = _mm_set1_epi32((int)fg);
+    const __m128i bgs = _mm_set1_epi32((int)bg);
+    const __m128i fg2s = _mm_set1_epi32((int)fg2);
+    const __m128i blends = _mm_set1_epi32((int)blend);
+    const __m128i lanes = _mm_set_epi32(1, 2, 4, 8);
+    const __m128 ts = _mm_set1_ps(t);
+
+    auto lerp = [&](__m128i current, __m128i target)
+    {
+        __m128 difference = _mm_cvtepi32_ps(_mm_sub_epi32(target, current));
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_cvtepi32_ps(current), _mm_mul_ps(difference, ts)));
+    };
+    auto select = [](__m128i mask, __m128i a, __m128i b)
+    {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    };
+
+    __m128i changed = zero, fading = zero;
+    for (uint32_t x = 0; x < 64; x += 4)
+    {
+        __m128i* address = (__m128i*)(pixels + x);
+        const __m128i current = _mm_loadu_si128(address);
+
+        // Lanes take the color of the planes they're lit in
+        const __m128i nibble = _mm_set1_epi32((int)((bits >> (60 - x)) & 0xF));
+        const __m128i nibble2 = _mm_set1_epi32((int)((bits2 >> (60 - x)) & 0xF));
+        const __m128i isOn = _mm_cmpeq_epi32(_mm_and_si128(nibble, lanes), lanes);
+        const __m128i isOn2 = _mm_cmpeq_epi32(_mm_and_si128(nibble2, lanes), lanes);
+        const __m128i target = select(isOn2, select(isOn, blends, fg2s), select(isOn, fgs, bgs));
+
+        const __m128i current16[2] = { _mm_unpacklo_epi8(current, zero), _mm_unpackhi_epi8(current, zero) };
+        const __m128i target16[2] = { _mm_unpacklo_epi8(target, zero), _mm_unpackhi_epi8(target, zero) };
+
+        __m128i next16[2];
+        for (int i = 0; i < 2; ++i)
+        {
+            __m128i low = lerp(_mm_unpacklo_epi16(current16[i], zero), _mm_unpacklo_epi16(target16[i], zero));
+            __m128i high = lerp(_mm_unpackhi_epi16(current16[i], zero), _mm_unpackhi_epi16(target16[i], zero));
+            next16[i] = _mm_packs_epi32(low, high);
+        }
+        __m128i next = _mm_packus_epi16(next16[0], next16[1]);
+
+        // Settle on the target once the steps round down to nothing
+        next = select(_mm_cmpeq_epi32(next, current), target, next);
+        _mm_storeu_si128(address, next);
+
+        changed = _mm_or_si128(changed, _mm_xor_si128(next, current));
+        fading = _mm_or_si128(fading, _mm_xor_si128(next, target));
+    }
+
+    isFading = _mm_movemask_epi8(_mm_cmpeq_epi8(fading, zero)) != 0xFFFF;
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(changed, zero)) != 0xFFFF;
+}
+
+const char*
+Framebuffer::GetKernelName()
+{
+    return "SSE2";
+}
+
+#else
+
+bool
+Framebuffer::FadeRow(rgba_t* pixels, uint64_t bits, uint64_t bits2, const palette_t &palette, float t, bool &isFading)
+{
+    return FadeRowScalar(pixels, bits, bits2, palette, t, isFading);
+}
+
+const char*
+Framebuffer::GetKernelName()
+{
+    return "scalar";
+}
+
+#endif
@@ -0,0 +1,137 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_FRAMEBUFFER_H
+#define CHIP0U_FRAMEBUFFER_H
+
+#include "chip8/Chip8.h"
+#include "render/Deflicker.h"
+
+// Kernel fading the pixels
+#if defined(__AVX2__)
+#define CHIP0U_FADE_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#define CHIP0U_FADE_SSE2 1
+#endif
+
+
+// The display as RGBA pixels, each fading towards the color of its CHIP-8 pixel.
+//
+// Composition is plain CPU work over the rows the core reports as changed, or still fading; the
+// result is uploaded by whoever draws it. Nothing here needs a window or a GPU.
+class Framebuffer
+{
+public:
+    // Same layout as raylib's Color
+    typedef struct rgba_t
+    {
+        uint8_t r, g, b, a;
+    } rgba_t;
+
+    // Colors by the planes a pixel is lit in: none, the first, the second (XO-CHIP) or both
+    typedef struct palette_t
+    {
+        rgba_t bg;
+        rgba_t fg;
+        rgba_t fg2;
+        rgba_t blend;
+    } palette_t;
+
+public:
+    // Every pixel to `color`, fading from there
+    void Reset(rgba_t color);
+
+    // Fade every row again, as after a palette change
+    void Refade();
+
+    // Move the pixels one frame of `deltaTime` seconds closer to the display of `frame`, halving the
+    // distance every `halfLife` seconds. A change of resolution starts over from the background.
+    // Returns whether any pixel changed
+    bool Compose(const Chip8::frame_t &frame, const palette_t &palette, float halfLife, float deltaTime);
+
+    // The same, towards the blend of `deflicker`
+    bool Compose(const Deflicker &deflicker, const palette_t &palette, float halfLife, float deltaTime);
+
+    // GetWidth() x GetHeight() pixels, row by row
+    const rgba_t* GetPixels() const;
+    uint32_t GetWidth() const;
+    uint32_t GetHeight() const;
+
+    // Rows not yet at their colors, one bit each
+    uint64_t GetFadingRows() const;
+
+    [[nodiscard]] static bool IsSameColor(rgba_t a, rgba_t b);
+
+    // Move a row of 64 pixels a fraction `t` of the way to the colors of `bits` and `bits2`, the
+    // first and second plane (leftmost pixel in the top bit). Returns whether any pixel changed;
+    // `isFading` tells whether any is still short of its color. FadeRow() is the vectorised kernel,
+    // with the same results as FadeRowScalar()
+    static bool FadeRow(rgba_t* pixels, uint64_t bits, uint64_t bits2, const palette_t &palette, float t, bool &isFading);
+    static bool FadeRowScalar(rgba_t* pixels, uint64_t bits, uint64_t bits2, const palette_t &palette, float t, bool &isFading);
+    static const char* GetKernelName();
+
+private:
+    // Fade towards the planes `display` and `display2` of a `width` x `height` display, of which
+    // `changedRows` changed since the last frame
+    bool Compose(const uint64_t* display, const uint64_t* display2, uint32_t width, uint32_t height,
+                 uint64_t changedRows, const palette_t &palette, float halfLife, float deltaTime);
+
+private:
+    rgba_t m_pixels[DISPLAY_SIZE] {};
+    uint32_t m_width {LORES_WIDTH}, m_height {LORES_HEIGHT};
+
+    // Last display generation composed, and rows still fading
+    uint64_t m_generation {0};
+    uint64_t m_fadingRows {~0ull};
+};
+
+inline const Framebuffer::rgba_t*
+Framebuffer::GetPixels() const
+{
+    return m_pixels;
+}
+
+inline uint32_t
+Framebuffer::GetWidth() const
+{
+    return m_width;
+}
+
+inline uint32_t
+Framebuffer::GetHeight() const
+{
+    return m_height;
+}
+
+inline uint64_t
+Framebuffer::GetFadingRows() const
+{
+    return m_fadingRows;
+}
+
+inline bool
+Framebuffer::IsSameColor(rgba_t a, rgba_t b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+#endif //CHIP0U_FRAMEBUFFER_H
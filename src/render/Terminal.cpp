@@ -0,0 +1,231 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Terminal.h"
+
+#include <bit>
+#include <cstring>
+
+#include <unistd.h>
+
+// Cells by their top and bottom pixels: none, bottom, top, both
+static const char* s_glyphs[4] = { " ", "▄", "▀", "█" };
+
+// Unchanged cells rewritten rather than moving the cursor over them; a move costs 6 to 8 bytes
+static constexpr uint32_t s_maxGap = 2;
+
+// Frames a key stays down after a press
+static constexpr uint8_t s_keyHoldFrames = 10;
+
+// Keys of the same layout as the window's: 1234 / QWER / ASDF / ZXCV
+static int8_t
+GetKey(char c)
+{
+    switch (c)
+    {
+        case '1': return 0x1;
+        case '2': return 0x2;
+        case '3': return 0x3;
+        case '4': return 0xC;
+        case 'q': case 'Q': return 0x4;
+        case 'w': case 'W': return 0x5;
+        case 'e': case 'E': return 0x6;
+        case 'r': case 'R': return 0xD;
+        case 'a': case 'A': return 0x7;
+        case 's': case 'S': return 0x8;
+        case 'd': case 'D': return 0x9;
+        case 'f': case 'F': return 0xE;
+        case 'z': case 'Z': return 0xA;
+        case 'x': case 'X': return 0x0;
+        case 'c': case 'C': return 0xB;
+        case 'v': case 'V': return 0xF;
+        default:  return -1;
+    }
+}
+
+
+Terminal::~Terminal()
+{
+    Close();
+}
+
+bool
+Terminal::Open(int input, int output)
+{
+    m_input = input;
+    m_output = output;
+
+    // No echo, no line buffering and no signals; reads return whatever is there
+    if (isatty(input) && tcgetattr(input, &m_settings) == 0)
+    {
+        termios raw = m_settings;
+        raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+        raw.c_iflag &= ~(IXON | ICRNL);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        m_isRaw = tcsetattr(input, TCSANOW, &raw) == 0;
+    }
+
+    // Alternate screen, no cursor, cleared: the display is blank there
+    const uint64_t bytesWritten = m_bytesWritten;
+    m_frame = "\x1b[?1049h\x1b[?25l";
+    Clear(LORES_HEIGHT);
+    Write(m_frame);
+
+    return m_bytesWritten != bytesWritten;
+}
+
+void
+Terminal::Clear(uint32_t height)
+{
+    m_generation = 0;
+    m_height = height;
+    memset(m_shown, 0, sizeof(m_shown));
+
+    m_frame += "\x1b[2J\x1b[" + std::to_string(height / 2 + 2) + ";1HEsc to quit";
+}
+
+void
+Terminal::Close()
+{
+    if (m_output < 0) return;
+
+    Write("\x1b[?25h\x1b[?1049l");
+    if (m_isRaw) tcsetattr(m_input, TCSANOW, &m_settings);
+
+    m_isRaw = false;
+    m_input = m_output = -1;
+}
+
+bool
+Terminal::Input(Chip8 &chip8)
+{
+    // Release keys not pressed again in time
+    for (uint8_t key = 0; key < KEYPAD_SIZE; ++key)
+    {
+        if (m_keyFrames[key] != 0 && --m_keyFrames[key] == 0) chip8.SetKey(key, false);
+    }
+
+    if (!m_isRaw) return true;
+
+    char buffer[64];
+    const ssize_t length = read(m_input, buffer, sizeof(buffer));
+    for (ssize_t i = 0; i < length; ++i)
+    {
+        const char c = buffer[i];
+        if (c == 0x03) return false;
+
+        if (c == 0x1B)
+        {
+            // Esc on its own quits; the sequences of arrows and function keys are skipped
+            if (i + 1 == length || (buffer[i + 1] != '[' && buffer[i + 1] != 'O')) return false;
+            for (i += 2; i < length && (buffer[i] < 0x40 || buffer[i] > 0x7E); ++i) {}
+            continue;
+        }
+
+        const int8_t key = GetKey(c);
+        if (key < 0) continue;
+
+        chip8.SetKey(key, true);
+        m_keyFrames[key] = s_keyHoldFrames;
+    }
+
+    return true;
+}
+
+void
+Terminal::Present(const Chip8 &chip8)
+{
+    m_frame.clear();
+
+    // The other resolution starts from a blank screen, with the status line below it
+    if (chip8.GetDisplayHeight() != m_height) Clear(chip8.GetDisplayHeight());
+
+    // Lines holding a row that changed since the last frame
+    const uint64_t rows = chip8.GetDirtyRows(m_generation);
+    const uint32_t words = chip8.GetDisplayWidth() / 64;
+
+    for (uint32_t line = 0; line < m_height / 2; ++line)
+    {
+        if (((rows >> (line * 2)) & 3) == 0) continue;
+
+        // A cell is lit in any plane; the terminal has one color
+        uint64_t top[DISPLAY_WORDS], bottom[DISPLAY_WORDS];
+        for (uint32_t w = 0; w < words; ++w)
+        {
+            const uint32_t word = line * 2 * DISPLAY_WORDS + w;
+            top[w] = chip8.GetDisplay()[word] | chip8.GetDisplay(1)[word];
+            bottom[w] = chip8.GetDisplay()[word + DISPLAY_WORDS] | chip8.GetDisplay(1)[word + DISPLAY_WORDS];
+        }
+        auto glyph = [&](uint32_t x)
+        {
+            const uint32_t w = x / 64, bit = 63 - x % 64;
+            return s_glyphs[((top[w] >> bit) & 1) << 1 | ((bottom[w] >> bit) & 1)];
+        };
+
+        // Runs of changed cells, each after a cursor move unless the gap is cheaper to rewrite
+        uint32_t cursor = ~0u;
+        for (uint32_t w = 0; w < words; ++w)
+        {
+            const uint64_t changed = (top[w] ^ m_shown[line * 2][w]) | (bottom[w] ^ m_shown[line * 2 + 1][w]);
+            for (uint64_t bits = changed; bits != 0; bits &= ~(1ull << (63 - std::countl_zero(bits))))
+            {
+                const uint32_t x = w * 64 + std::countl_zero(bits);
+                if (cursor != ~0u && x - cursor <= s_maxGap)
+                {
+                    for (; cursor < x; ++cursor) m_frame += glyph(cursor);
+                }
+                else if (cursor != x)
+                {
+                    m_frame += "\x1b[" + std::to_string(line + 1) + ";" + std::to_string(x + 1) + "H";
+                }
+
+                m_frame += glyph(x);
+                cursor = x + 1;
+            }
+
+            m_shown[line * 2][w] = top[w];
+            m_shown[line * 2 + 1][w] = bottom[w];
+        }
+    }
+
+    // The bell, once per sound
+    const bool isBeeping = chip8.GetState().ST > 0;
+    if (isBeeping && !m_isBeeping) m_frame += '\a';
+    m_isBeeping = isBeeping;
+
+    ++m_frameCount;
+    if (!m_frame.empty()) Write(m_frame);
+}
+
+void
+Terminal::Write(const std::string &text)
+{
+    for (size_t offset = 0; offset < text.size();)
+    {
+        const ssize_t written = write(m_output, text.data() + offset, text.size() - offset);
+        if (written <= 0) return;
+
+        offset += written;
+        m_bytesWritten += written;
+    }
+}
@@ -0,0 +1,104 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_TERMINAL_H
+#define CHIP0U_TERMINAL_H
+
+#include <string>
+
+#include <termios.h>
+
+#include "chip8/Chip8.h"
+
+
+// The display on an ANSI terminal, two CHIP-8 rows per line of half blocks, and the keypad from it.
+// The SUPER-CHIP display takes 128 columns and 32 lines.
+//
+// Every frame writes only the cells that changed since the last one, as a single write. Terminals
+// report key presses but not releases, so a key stays down for a few frames after each press;
+// the key repeat of a held key keeps it down.
+class Terminal
+{
+public:
+    ~Terminal();
+
+    // Take over the terminal: `output` switches to its alternate screen, and `input`, when it is a
+    // TTY, to raw mode. Returns false when `output` cannot be written
+    bool Open(int input, int output);
+
+    // Give the terminal back as it was
+    void Close();
+
+    // Apply the keys pressed since the last call. Returns false once Esc or Ctrl-C is pressed
+    bool Input(Chip8 &chip8);
+
+    // Bring the screen up to the display of `chip8`
+    void Present(const Chip8 &chip8);
+
+    uint64_t GetBytesWritten() const;
+    uint64_t GetFrameCount() const;
+
+private:
+    // Blank the screen for a display `height` rows high
+    void Clear(uint32_t height);
+
+    void Write(const std::string &text);
+
+private:
+    int m_input {-1};
+    int m_output {-1};
+
+    // Terminal settings to restore, when the input was put in raw mode
+    termios m_settings {};
+    bool    m_isRaw {false};
+
+    // Display generation, height and rows on the screen
+    uint64_t m_generation {0};
+    uint32_t m_height {LORES_HEIGHT};
+    uint64_t m_shown[DISPLAY_HEIGHT][DISPLAY_WORDS] {};
+
+    // Frames each key stays down for
+    uint8_t m_keyFrames[KEYPAD_SIZE] {};
+
+    // Sound timer was running on the last frame
+    bool m_isBeeping {false};
+
+    // Escape sequences of the frame being built
+    std::string m_frame;
+
+    uint64_t m_bytesWritten {0};
+    uint64_t m_frameCount {0};
+};
+
+inline uint64_t
+Terminal::GetBytesWritten() const
+{
+    return m_bytesWritten;
+}
+
+inline uint64_t
+Terminal::GetFrameCount() const
+{
+    return m_frameCount;
+}
+
+#endif //CHIP0U_TERMINAL_H
@@ -0,0 +1,385 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Upscaler.h"
+
+#include <algorithm>
+
+#if defined(CHIP0U_SCALE_SSE2)
+#include <emmintrin.h>
+#endif
+
+typedef Upscaler::rgba_t rgba_t;
+
+// Whole vector stores may run this many pixels past the end of a block row
+static constexpr uint32_t s_overrun = 3;
+
+// Shadow mask weight of the channels a column does not show, and how many rows of a block are
+// scanline, out of every 4
+static constexpr uint16_t s_maskWeight = 192;
+static constexpr uint32_t s_scanlineQuarters = 1;
+
+// One row of `width` pixels as blocks `scale` pixels wide
+static void
+NearestRow(const rgba_t* source, uint32_t width, uint32_t scale, rgba_t* output)
+{
+#if defined(CHIP0U_SCALE_SSE2)
+    // Every block as whole vectors of its color, each one running into the next block
+    const uint32_t stores = (scale + 3) / 4;
+    for (uint32_t x = 0; x < width; ++x)
+    {
+        uint32_t color;
+        memcpy(&color, source + x, sizeof(color));
+
+        const __m128i colors = _mm_set1_epi32((int)color);
+        __m128i* address = (__m128i*)(output + x * scale);
+        for (uint32_t i = 0; i < stores; ++i) _mm_storeu_si128(address + i, colors);
+    }
+#else
+    for (uint32_t x = 0; x < width; ++x) std::fill_n(output + x * scale, scale, source[x]);
+#endif
+}
+
+#if defined(CHIP0U_SCALE_SSE2)
+
+static inline __m128i
+Select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i
+Load(const rgba_t* pixels)
+{
+    return _mm_loadu_si128((const __m128i*)pixels);
+}
+
+// a0 b0 c0 a1 | b1 c1 a2 b2 | c2 a3 b3 c3, into `output`
+static inline void
+Store3(rgba_t* output, __m128i a, __m128i b, __m128i c)
+{
+    const __m128 ab = _mm_castsi128_ps(_mm_unpacklo_epi32(a, b));
+    const __m128 ca = _mm_castsi128_ps(_mm_unpacklo_epi32(c, a));
+    const __m128 bc = _mm_castsi128_ps(_mm_unpacklo_epi32(b, c));
+    const __m128 abHigh = _mm_castsi128_ps(_mm_unpackhi_epi32(a, b));
+    const __m128 caHigh = _mm_castsi128_ps(_mm_unpackhi_epi32(c, a));
+    const __m128 bcHigh = _mm_castsi128_ps(_mm_unpackhi_epi32(b, c));
+
+    __m128i* address = (__m128i*)output;
+    _mm_storeu_si128(address + 0, _mm_castps_si128(_mm_shuffle_ps(ab, ca, _MM_SHUFFLE(3, 0, 1, 0))));
+    _mm_storeu_si128(address + 1, _mm_castps_si128(_mm_shuffle_ps(bc, abHigh, _MM_SHUFFLE(1, 0, 3, 2))));
+    _mm_storeu_si128(address + 2, _mm_castps_si128(_mm_shuffle_ps(caHigh, bcHigh, _MM_SHUFFLE(3, 2, 3, 0))));
+}
+
+#endif
+
+
+void
+Upscaler::Configure(filter_t filter, uint32_t width, uint32_t height, uint32_t scale)
+{
+    m_filter = filter;
+    m_width = width;
+    m_height = height;
+    m_scale = GetScaleFor(filter, scale);
+
+    const uint32_t outWidth = GetWidth();
+    m_pixels.assign(outWidth * GetHeight() + s_overrun, {0, 0, 0, 0});
+
+    const uint32_t epxScale = filter == filter_t::Scale2x ? 2 : filter == filter_t::Scale3x ? 3 : 0;
+    m_padded.assign(epxScale ? (width + 2) * (height + 2) : 0, {0, 0, 0, 0});
+    m_epx.assign(epxScale && m_scale != epxScale ? width * height * epxScale * epxScale : 0, {0, 0, 0, 0});
+
+    if (filter != filter_t::Crt)
+    {
+        m_row.clear();
+        m_weights[0].clear();
+        m_weights[1].clear();
+        return;
+    }
+
+    // Every column shows one of red, green and blue in full, and the scanline rows half of that
+    m_row.assign(outWidth + s_overrun, {0, 0, 0, 0});
+    for (auto &weights : m_weights) weights.resize(outWidth * 4);
+    for (uint32_t x = 0; x < outWidth; ++x)
+    {
+        for (uint32_t channel = 0; channel < 4; ++channel)
+        {
+            const uint16_t weight = (channel == 3 || channel == x % 3) ? 256 : s_maskWeight;
+            m_weights[0][x * 4 + channel] = weight;
+            m_weights[1][x * 4 + channel] = channel == 3 ? weight : weight / 2;
+        }
+    }
+}
+
+void
+Upscaler::Run(const rgba_t* source)
+{
+    switch (m_filter)
+    {
+        case filter_t::Nearest:
+            Nearest(source, m_width, m_height, m_scale, m_pixels.data());
+            break;
+
+        case filter_t::Scale2x:
+        case filter_t::Scale3x:
+        {
+            const uint32_t epxScale = m_filter == filter_t::Scale2x ? 2 : 3;
+            rgba_t* epx = m_epx.empty() ? m_pixels.data() : m_epx.data();
+
+            Pad(source);
+            if (m_filter == filter_t::Scale2x) Scale2x(epx);
+            else Scale3x(epx);
+
+            // Blocks of the smoothed pixels for the rest of the scale
+            if (!m_epx.empty())
+            {
+                Nearest(epx, m_width * epxScale, m_height * epxScale, m_scale / epxScale, m_pixels.data());
+            }
+            break;
+        }
+
+        case filter_t::Crt:
+            Crt(source);
+            break;
+
+        default:
+            memcpy(m_pixels.data(), source, m_width * m_height * sizeof(rgba_t));
+            break;
+    }
+}
+
+const char*
+Upscaler::GetFilterName(filter_t filter)
+{
+    switch (filter)
+    {
+        case filter_t::None:    return "None";
+        case filter_t::Nearest: return "Nearest";
+        case filter_t::Scale2x: return "Scale2x";
+        case filter_t::Scale3x: return "Scale3x";
+        case filter_t::Crt:     return "CRT";
+        default:                return "Unknown";
+    }
+}
+
+uint32_t
+Upscaler::GetScaleFor(filter_t filter, uint32_t scale)
+{
+    switch (filter)
+    {
+        case filter_t::Nearest: return std::max(1u, scale);
+        case filter_t::Scale2x: return std::max(2u, scale - scale % 2);
+        case filter_t::Scale3x: return std::max(3u, scale - scale % 3);
+        case filter_t::Crt:     return std::max(2u, scale);
+        default:                return 1;
+    }
+}
+
+void
+Upscaler::Pad(const rgba_t* source)
+{
+    const uint32_t stride = m_width + 2;
+    for (uint32_t y = 0; y < m_height + 2; ++y)
+    {
+        const rgba_t* row = source + std::clamp(y, 1u, m_height) * m_width - m_width;
+        rgba_t* padded = m_padded.data() + y * stride;
+
+        padded[0] = row[0];
+        memcpy(padded + 1, row, m_width * sizeof(rgba_t));
+        padded[m_width + 1] = row[m_width - 1];
+    }
+}
+
+void
+Upscaler::Nearest(const rgba_t* source, uint32_t width, uint32_t height, uint32_t scale, rgba_t* output)
+{
+    const uint32_t outWidth = width * scale;
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        rgba_t* row = output + y * scale * outWidth;
+        NearestRow(source + y * width, width, scale, row);
+
+        for (uint32_t i = 1; i < scale; ++i) memcpy(row + i * outWidth, row, outWidth * sizeof(rgba_t));
+    }
+}
+
+// E is the pixel, B, D, F and H the ones above, left, right and below it. Where B and H differ and
+// so do D and F, each quarter of E takes the color of the two neighbours at its corner, if they match
+void
+Upscaler::Scale2x(rgba_t* output) const
+{
+    const uint32_t stride = m_width + 2;
+    const uint32_t outWidth = m_width * 2;
+
+    for (uint32_t y = 0; y < m_height; ++y)
+    {
+        const rgba_t* above = m_padded.data() + y * stride + 1;
+        const rgba_t* row = above + stride;
+        const rgba_t* below = row + stride;
+        rgba_t* top = output + y * 2 * outWidth;
+        rgba_t* bottom = top + outWidth;
+
+        uint32_t x = 0;
+#if defined(CHIP0U_SCALE_SSE2)
+        for (; x + 4 <= m_width; x += 4)
+        {
+            const __m128i B = Load(above + x), H = Load(below + x);
+            const __m128i D = Load(row + x - 1), E = Load(row + x), F = Load(row + x + 1);
+
+            const __m128i isEdge = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F)),
+                                                    _mm_cmpeq_epi32(E, E));
+
+            const __m128i E0 = Select(_mm_and_si128(isEdge, _mm_cmpeq_epi32(D, B)), D, E);
+            const __m128i E1 = Select(_mm_and_si128(isEdge, _mm_cmpeq_epi32(B, F)), F, E);
+            const __m128i E2 = Select(_mm_and_si128(isEdge, _mm_cmpeq_epi32(D, H)), D, E);
+            const __m128i E3 = Select(_mm_and_si128(isEdge, _mm_cmpeq_epi32(H, F)), F, E);
+
+            _mm_storeu_si128((__m128i*)(top + x * 2), _mm_unpacklo_epi32(E0, E1));
+            _mm_storeu_si128((__m128i*)(top + x * 2 + 4), _mm_unpackhi_epi32(E0, E1));
+            _mm_storeu_si128((__m128i*)(bottom + x * 2), _mm_unpacklo_epi32(E2, E3));
+            _mm_storeu_si128((__m128i*)(bottom + x * 2 + 4), _mm_unpackhi_epi32(E2, E3));
+        }
+#endif
+        for (; x < m_width; ++x)
+        {
+            const rgba_t* b = above + x;
+            const rgba_t* e = row + x;
+            const rgba_t* h = below + x;
+
+            const rgba_t B = b[0], H = h[0];
+            const rgba_t D = e[-1], E = e[0], F = e[1];
+            auto same = Framebuffer::IsSameColor;
+
+            const bool isEdge = !same(B, H) && !same(D, F);
+            top[x * 2]        = isEdge && same(D, B) ? D : E;
+            top[x * 2 + 1]    = isEdge && same(B, F) ? F : E;
+            bottom[x * 2]     = isEdge && same(D, H) ? D : E;
+            bottom[x * 2 + 1] = isEdge && same(H, F) ? F : E;
+        }
+    }
+}
+
+// As Scale2x, over the 3x3 neighbourhood A B C / D E F / G H I; the middle of each side also takes
+// the color of its side where that runs into a different corner
+void
+Upscaler::Scale3x(rgba_t* output) const
+{
+    const uint32_t stride = m_width + 2;
+    const uint32_t outWidth = m_width * 3;
+
+    for (uint32_t y = 0; y < m_height; ++y)
+    {
+        const rgba_t* above = m_padded.data() + y * stride + 1;
+        const rgba_t* row = above + stride;
+        const rgba_t* below = row + stride;
+        rgba_t* out[3] = { output + y * 3 * outWidth, output + (y * 3 + 1) * outWidth, output + (y * 3 + 2) * outWidth };
+
+        uint32_t x = 0;
+#if defined(CHIP0U_SCALE_SSE2)
+        for (; x + 4 <= m_width; x += 4)
+        {
+            const __m128i A = Load(above + x - 1), B = Load(above + x), C = Load(above + x + 1);
+            const __m128i D = Load(row + x - 1),   E = Load(row + x),   F = Load(row + x + 1);
+            const __m128i G = Load(below + x - 1), H = Load(below + x), I = Load(below + x + 1);
+
+            const __m128i isEdge = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F)),
+                                                    _mm_cmpeq_epi32(E, E));
+            const __m128i DB = _mm_and_si128(isEdge, _mm_cmpeq_epi32(D, B));
+            const __m128i BF = _mm_and_si128(isEdge, _mm_cmpeq_epi32(B, F));
+            const __m128i DH = _mm_and_si128(isEdge, _mm_cmpeq_epi32(D, H));
+            const __m128i HF = _mm_and_si128(isEdge, _mm_cmpeq_epi32(H, F));
+            const __m128i EA = _mm_cmpeq_epi32(E, A), EC = _mm_cmpeq_epi32(E, C);
+            const __m128i EG = _mm_cmpeq_epi32(E, G), EI = _mm_cmpeq_epi32(E, I);
+
+            auto side = [](__m128i a, __m128i notA, __m128i b, __m128i notB)
+            {
+                return _mm_or_si128(_mm_andnot_si128(notA, a), _mm_andnot_si128(notB, b));
+            };
+
+            Store3(out[0] + x * 3, Select(DB, D, E), Select(side(DB, EC, BF, EA), B, E), Select(BF, F, E));
+            Store3(out[1] + x * 3, Select(side(DB, EG, DH, EA), D, E), E, Select(side(BF, EI, HF, EC), F, E));
+            Store3(out[2] + x * 3, Select(DH, D, E), Select(side(DH, EI, HF, EG), H, E), Select(HF, F, E));
+        }
+#endif
+        for (; x < m_width; ++x)
+        {
+            const rgba_t* b = above + x;
+            const rgba_t* e = row + x;
+            const rgba_t* h = below + x;
+
+            const rgba_t A = b[-1], B = b[0], C = b[1];
+            const rgba_t D = e[-1], E = e[0], F = e[1];
+            const rgba_t G = h[-1], H = h[0], I = h[1];
+            auto same = Framebuffer::IsSameColor;
+
+            const bool isEdge = !same(B, H) && !same(D, F);
+            const bool DB = isEdge && same(D, B), BF = isEdge && same(B, F);
+            const bool DH = isEdge && same(D, H), HF = isEdge && same(H, F);
+
+            out[0][x * 3]     = DB ? D : E;
+            out[0][x * 3 + 1] = (DB && !same(E, C)) || (BF && !same(E, A)) ? B : E;
+            out[0][x * 3 + 2] = BF ? F : E;
+            out[1][x * 3]     = (DB && !same(E, G)) || (DH && !same(E, A)) ? D : E;
+            out[1][x * 3 + 1] = E;
+            out[1][x * 3 + 2] = (BF && !same(E, I)) || (HF && !same(E, C)) ? F : E;
+            out[2][x * 3]     = DH ? D : E;
+            out[2][x * 3 + 1] = (DH && !same(E, I)) || (HF && !same(E, G)) ? H : E;
+            out[2][x * 3 + 2] = HF ? F : E;
+        }
+    }
+}
+
+// Every block row is the row of blocks weighted channel by channel: the shadow mask, and darker at
+// the bottom of the block
+void
+Upscaler::Crt(const rgba_t* source)
+{
+    const uint32_t outWidth = GetWidth();
+    const uint32_t scanlines = std::max(1u, m_scale * s_scanlineQuarters / 4);
+
+    for (uint32_t y = 0; y < m_height; ++y)
+    {
+        NearestRow(source + y * m_width, m_width, m_scale, m_row.data());
+
+        for (uint32_t i = 0; i < m_scale; ++i)
+        {
+            const uint16_t* weights = m_weights[i >= m_scale - scanlines].data();
+            const uint8_t* in = (const uint8_t*)m_row.data();
+            uint8_t* out = (uint8_t*)(m_pixels.data() + (y * m_scale + i) * outWidth);
+
+            uint32_t x = 0;
+#if defined(CHIP0U_SCALE_SSE2)
+            const __m128i zero = _mm_setzero_si128();
+            for (; x + 4 <= outWidth; x += 4)
+            {
+                const __m128i pixels = _mm_loadu_si128((const __m128i*)(in + x * 4));
+                const __m128i low = _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero),
+                                                    _mm_loadu_si128((const __m128i*)(weights + x * 4)));
+                const __m128i high = _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero),
+                                                     _mm_loadu_si128((const __m128i*)(weights + x * 4 + 8)));
+                _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(_mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8)));
+            }
+#endif
+            for (x *= 4; x < outWidth * 4; ++x) out[x] = (uint8_t)((in[x] * weights[x]) >> 8);
+        }
+    }
+}
@@ -0,0 +1,144 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_UPSCALER_H
+#define CHIP0U_UPSCALER_H
+
+#include <vector>
+
+#include "render/Framebuffer.h"
+
+// Kernels scaling the pixels
+#if defined(__SSE2__) || defined(_M_X64)
+#define CHIP0U_SCALE_SSE2 1
+#endif
+
+
+// Scales composed pixels up by an integer factor, on the CPU, through one of a few filters.
+//
+// Configure() once per filter, source size or scale, then Run() on every frame whose pixels
+// changed. The output is as many pixels as the filter can fit in the scale asked for.
+class Upscaler
+{
+public:
+    typedef Framebuffer::rgba_t rgba_t;
+
+    enum class filter_t : uint8_t
+    {
+        None,           // The pixels as they are, left for the GPU to stretch
+        Nearest,        // Every pixel as a block
+        Scale2x,        // EPX: edges smoothed at 2x, then blocks
+        Scale3x,        // EPX: edges smoothed at 3x, then blocks
+        Crt,            // Blocks over a shadow mask, with dark scanlines between rows
+
+        Count
+    };
+
+public:
+    // Scale `width` x `height` pixels by up to `scale` through `filter`
+    void Configure(filter_t filter, uint32_t width, uint32_t height, uint32_t scale);
+
+    // Scale a frame of the configured size
+    void Run(const rgba_t* source);
+
+    const rgba_t* GetPixels() const;
+    uint32_t GetSourceWidth() const;
+    uint32_t GetSourceHeight() const;
+    uint32_t GetWidth() const;
+    uint32_t GetHeight() const;
+    uint32_t GetScale() const;
+    filter_t GetFilter() const;
+
+    static const char* GetFilterName(filter_t filter);
+
+    // Largest factor `filter` scales by, up to `scale`
+    [[nodiscard]] static uint32_t GetScaleFor(filter_t filter, uint32_t scale);
+
+private:
+    // Source rows with a border of their own edge pixels, for the EPX neighbourhoods
+    void Pad(const rgba_t* source);
+
+    static void Nearest(const rgba_t* source, uint32_t width, uint32_t height, uint32_t scale, rgba_t* output);
+    void Scale2x(rgba_t* output) const;
+    void Scale3x(rgba_t* output) const;
+    void Crt(const rgba_t* source);
+
+private:
+    filter_t m_filter {filter_t::None};
+    uint32_t m_width {0}, m_height {0};
+    uint32_t m_scale {1};
+
+    // Output, with room for the last vector store of a row to run over
+    std::vector<rgba_t> m_pixels;
+
+    // Padded source, and the EPX result before the blocks
+    std::vector<rgba_t> m_padded;
+    std::vector<rgba_t> m_epx;
+
+    // CRT: one output row of blocks, and the per channel weights of lit and scanline rows (x256)
+    std::vector<rgba_t> m_row;
+    std::vector<uint16_t> m_weights[2];
+};
+
+inline const Upscaler::rgba_t*
+Upscaler::GetPixels() const
+{
+    return m_pixels.data();
+}
+
+inline uint32_t
+Upscaler::GetSourceWidth() const
+{
+    return m_width;
+}
+
+inline uint32_t
+Upscaler::GetSourceHeight() const
+{
+    return m_height;
+}
+
+inline uint32_t
+Upscaler::GetWidth() const
+{
+    return m_width * m_scale;
+}
+
+inline uint32_t
+Upscaler::GetHeight() const
+{
+    return m_height * m_scale;
+}
+
+inline uint32_t
+Upscaler::GetScale() const
+{
+    return m_scale;
+}
+
+inline Upscaler::filter_t
+Upscaler::GetFilter() const
+{
+    return m_filter;
+}
+
+#endif //CHIP0U_UPSCALER_H
@@ -0,0 +1,78 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_SPSCQUEUE_H
+#define CHIP0U_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded queue from one thread to another, without locks: a ring of N slots, the writer owning the
+// tail and the reader the head
+//
+// Only one writer and one reader thread. N must be a power of two
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    // Writer: append `item`. Returns false, leaving the queue as it was, when it is full
+    bool Push(const T &item);
+
+    // Reader: take the oldest item into `item`. Returns false when there is none
+    bool Pop(T &item);
+
+private:
+    T m_items[N] {};
+
+    // Counts of items pushed and popped, on lines of their own so the two threads don't share one
+    alignas(64) std::atomic<size_t> m_head {0};
+    alignas(64) std::atomic<size_t> m_tail {0};
+};
+
+template <typename T, size_t N>
+inline bool
+SpscQueue<T, N>::Push(const T &item)
+{
+    const size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == N) return false;
+
+    m_items[tail % N] = item;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T, size_t N>
+inline bool
+SpscQueue<T, N>::Pop(T &item)
+{
+    const size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+    item = std::move(m_items[head % N]);
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+#endif //CHIP0U_SPSCQUEUE_H
@@ -0,0 +1,89 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHIP0U_TRIPLEBUFFER_H
+#define CHIP0U_TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Hands values from one thread to another without either waiting: the writer fills the back buffer
+// and publishes it, the reader takes the newest one published. Values published before the reader
+// came back are skipped; neither side ever sees the other's buffer while it is being used.
+//
+// Only one writer and one reader thread
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer: the buffer to fill, then Publish() as the newest
+    T& GetBack();
+    void Publish();
+
+    // Reader: take the newest buffer published since the last call, if any. Returns whether there was
+    bool Update();
+    const T& GetFront() const;
+
+private:
+    // The middle buffer's index, and whether it was published since the reader last took it
+    static constexpr uint8_t FRESH = 0x4;
+    static constexpr uint8_t INDEX = 0x3;
+
+    T m_buffers[3] {};
+
+    uint8_t m_back {0};
+    uint8_t m_front {1};
+    std::atomic<uint8_t> m_middle {2};
+};
+
+template <typename T>
+inline T&
+TripleBuffer<T>::GetBack()
+{
+    return m_buffers[m_back];
+}
+
+template <typename T>
+inline void
+TripleBuffer<T>::Publish()
+{
+    m_back = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel) & INDEX;
+}
+
+template <typename T>
+inline bool
+TripleBuffer<T>::Update()
+{
+    if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0) return false;
+
+    m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+    return true;
+}
+
+template <typename T>
+inline const T&
+TripleBuffer<T>::GetFront() const
+{
+    return m_buffers[m_front];
+}
+
+#endif //CHIP0U_TRIPLEBUFFER_H
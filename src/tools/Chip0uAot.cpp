@@ -0,0 +1,255 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Chip0uAot: translates a ROM into an AOT module, builds it and checks it against the interpreter
+
+#include "chip8/Chip8.h"
+#include "chip8/Recompiler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Headers the modules include, passed to the compiler by `build`
+#ifndef CHIP0U_SOURCE_DIR
+#define CHIP0U_SOURCE_DIR "."
+#endif
+
+static void
+Usage()
+{
+    printf("Usage:\n");
+    printf("  Chip0uAot translate <rom> <module.cpp> [profile]   Write the module source\n");
+    printf("  Chip0uAot build     <rom> <module.so>  [profile]   Write and compile the module ($CXX, or c++)\n");
+    printf("  Chip0uAot validate  <rom> <module.so>  [cycles]    Run the module against the interpreter\n");
+    printf("Profiles: chip0u (default), chip8, schip, xochip\n");
+}
+
+static bool
+ParseProfile(const char* name, Chip8::profile_t &profile)
+{
+    static const char* names[] = { "chip0u", "chip8", "schip", "xochip" };
+    for (int i = 0; i < (int)Chip8::profile_t::Count; ++i)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            profile = (Chip8::profile_t)i;
+            return true;
+        }
+    }
+
+    printf("Unknown profile: %s\n", name);
+    return false;
+}
+
+// Size of the ROM as Chip8::LoadGame() loads it
+static uint16_t
+GetRomSize(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == nullptr) return 0;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+
+    return size > 0 && size < TOTAL_RAM - PROG_START ? (uint16_t)size : 0;
+}
+
+static bool
+Translate(const char* rom, const std::string &output, Chip8::profile_t profile)
+{
+    uint16_t size = GetRomSize(rom);
+    if (size == 0)
+    {
+        printf("Can't load %s\n", rom);
+        return false;
+    }
+
+    Chip8 chip8;
+    chip8.SetProfile(profile);
+    chip8.LoadGame(rom);
+
+    Recompiler recompiler(chip8.GetMemory(), size, profile, chip8.GetDisassembled());
+    std::string source = recompiler.Translate();
+
+    FILE* file = fopen(output.c_str(), "wb");
+    if (file == nullptr)
+    {
+        printf("Can't write %s\n", output.c_str());
+        return false;
+    }
+    fwrite(source.data(), 1, source.size(), file);
+    fclose(file);
+
+    printf("%s: %u blocks -> %s\n", rom, recompiler.GetBlockCount(), output.c_str());
+    return true;
+}
+
+static bool
+Build(const char* rom, const std::string &output, Chip8::profile_t profile)
+{
+    std::string source = output + ".cpp";
+    if (!Translate(rom, source, profile)) return false;
+
+    const char* compiler = getenv("CXX");
+    std::string command = std::string(compiler != nullptr ? compiler : "c++")
+                        + " -std=c++20 -O2 -shared -fPIC -I\"" CHIP0U_SOURCE_DIR "\" \"" + source + "\" -o \"" + output + "\"";
+
+    printf("%s\n", command.c_str());
+    return system(command.c_str()) == 0;
+}
+
+// Print what differs between two machines; returns whether anything does
+static bool
+Compare(const Chip8::chip8_t &expected, const Chip8::chip8_t &actual)
+{
+    bool isDifferent = false;
+    auto report = [&isDifferent](const char* what, uint32_t index, uint64_t a, uint64_t b)
+    {
+        printf("  %s[%u]: interpreter %llX, module %llX\n", what, index, (unsigned long long)a, (unsigned long long)b);
+        isDifferent = true;
+    };
+
+    for (uint32_t i = 0; i < TOTAL_REGISTERS; ++i) if (expected.V[i] != actual.V[i]) report("V", i, expected.V[i], actual.V[i]);
+    for (uint32_t i = 0; i < STACK_SIZE; ++i) if (expected.STACK[i] != actual.STACK[i]) report("STACK", i, expected.STACK[i], actual.STACK[i]);
+    for (uint32_t i = 0; i < TOTAL_RAM; ++i) if (expected.RAM[i] != actual.RAM[i]) report("RAM", i, expected.RAM[i], actual.RAM[i]);
+    for (uint32_t p = 0; p < PLANE_COUNT; ++p)
+    {
+        for (uint32_t y = 0; y < DISPLAY_HEIGHT; ++y)
+        {
+            for (uint32_t w = 0; w < DISPLAY_WORDS; ++w)
+            {
+                uint32_t index = (p * DISPLAY_HEIGHT + y) * DISPLAY_WORDS + w;
+                if (expected.DP[p][y][w] != actual.DP[p][y][w]) report("DP", index, expected.DP[p][y][w], actual.DP[p][y][w]);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < RPL_SIZE; ++i) if (expected.RPL[i] != actual.RPL[i]) report("RPL", i, expected.RPL[i], actual.RPL[i]);
+    if (expected.HIRES != actual.HIRES) report("HIRES", 0, expected.HIRES, actual.HIRES);
+    if (expected.PLANES != actual.PLANES) report("PLANES", 0, expected.PLANES, actual.PLANES);
+    if (expected.PITCH != actual.PITCH) report("PITCH", 0, expected.PITCH, actual.PITCH);
+    for (uint32_t i = 0; i < AUDIO_SIZE; ++i) if (expected.AUDIO[i] != actual.AUDIO[i]) report("AUDIO", i, expected.AUDIO[i], actual.AUDIO[i]);
+    if (expected.PC != actual.PC) report("PC", 0, expected.PC, actual.PC);
+    if (expected.I != actual.I)   report("I", 0, expected.I, actual.I);
+    if (expected.SP != actual.SP) report("SP", 0, expected.SP, actual.SP);
+    if (expected.DT != actual.DT) report("DT", 0, expected.DT, actual.DT);
+    if (expected.ST != actual.ST) report("ST", 0, expected.ST, actual.ST);
+
+    return isDifferent;
+}
+
+static bool
+Validate(const char* rom, const char* module, uint64_t cycles)
+{
+    Chip8 reference, translated;
+    translated.LoadGame(rom);
+    if (!translated.LoadAot(module)) return false;
+    translated.SetBackend(Chip8::backend_t::Aot);
+
+    reference.SetProfile(translated.GetProfile());
+    reference.LoadGame(rom);
+    reference.SetBackend(Chip8::backend_t::Interpreter);
+
+    if (translated.GetBackend() != Chip8::backend_t::Aot)
+    {
+        printf("%s can't run on this host\n", module);
+        return false;
+    }
+
+    // Same random numbers and inputs on both sides, in uneven slices, the inputs partway into them
+    const uint32_t seed = 0xC8;
+    reference.SetSeed(seed);
+    translated.SetSeed(seed);
+    std::mt19937 rng(seed);
+
+    uint64_t done = 0;
+    while (done < cycles)
+    {
+        uint32_t slice = rng() % 1000 + 1;
+        if (rng() % 16 == 0)
+        {
+            uint8_t key = rng() % KEYPAD_SIZE;
+            bool isDown = rng() % 2 == 0;
+            uint64_t cycle = reference.GetCycles() + rng() % slice;
+            reference.QueueKey(cycle, key, isDown);
+            translated.QueueKey(cycle, key, isDown);
+        }
+
+        reference.Run(slice);
+        translated.Run(slice);
+        done += slice;
+
+        if (Compare(reference.GetState(), translated.GetState()))
+        {
+            printf("%s: diverged within cycles %llu-%llu\n", module,
+                   (unsigned long long)(done - slice), (unsigned long long)done);
+            return false;
+        }
+    }
+
+    // Then as many again in one run, so a long budget can't go where short slices never do
+    const uint32_t budget = (uint32_t)std::min<uint64_t>(cycles, UINT32_MAX);
+    reference.Run(budget);
+    translated.Run(budget);
+    done += budget;
+
+    if (Compare(reference.GetState(), translated.GetState()))
+    {
+        printf("%s: diverged within cycles %llu-%llu\n", module,
+               (unsigned long long)(done - budget), (unsigned long long)done);
+        return false;
+    }
+
+    printf("%s: matches the interpreter over %llu cycles\n", module, (unsigned long long)done);
+    return true;
+}
+
+int
+main(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        Usage();
+        return 2;
+    }
+
+    std::string command = argv[1];
+    if (command == "translate" || command == "build")
+    {
+        Chip8::profile_t profile = Chip8::profile_t::Chip0u;
+        if (argc > 4 && !ParseProfile(argv[4], profile)) return 2;
+
+        bool isDone = command == "build" ? Build(argv[2], argv[3], profile) : Translate(argv[2], argv[3], profile);
+        return isDone ? 0 : 1;
+    }
+
+    if (command == "validate")
+    {
+        uint64_t cycles = argc > 4 ? strtoull(argv[4], nullptr, 10) : 10000000;
+        return Validate(argv[2], argv[3], cycles) ? 0 : 1;
+    }
+
+    Usage();
+    return 2;
+}
@@ -0,0 +1,294 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Chip0uBench: microbenchmarks of the parts of a frame that run on the CPU
+
+#include "chip8/Chip8.h"
+#include "render/Deflicker.h"
+#include "render/Framebuffer.h"
+#include "render/Upscaler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+
+typedef Framebuffer::rgba_t rgba_t;
+
+// Settings the front end starts with
+static const float s_precision = 0.01F;
+static const float s_lerpDuration = 0.7F;
+static const float s_frameTime = 1.0F / 60.0F;
+static const Framebuffer::palette_t s_palette = { {245, 245, 245, 255}, {0, 0, 0, 255}, {0, 121, 241, 255}, {190, 33, 55, 255} };
+
+static void
+Usage()
+{
+    printf("Usage:\n");
+    printf("  Chip0uBench fade [frames]           Cost of fading the whole display, per frame\n");
+    printf("  Chip0uBench scale [frames] [scale]  Cost of every upscaling filter, per output megapixel\n");
+    printf("  Chip0uBench deflicker [frames]      Cost of blending the last frames, per frame\n");
+    printf("  Chip0uBench runahead [frames]       Cost of running ahead and rolling back, per frame shown\n");
+}
+
+// Time `frames` calls of `frame`, in nanoseconds per call
+template <typename F>
+static double
+Measure(uint32_t frames, F &&frame)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frames; ++i) frame(i);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / frames;
+}
+
+// What the renderer did before the factor was hoisted out: the factor of every unsettled pixel
+// worked out on its own, from the settings and the frame time
+static void
+FadePerPixel(rgba_t* pixels, const uint64_t* display, float precision, float lerpDuration, float deltaTime)
+{
+    for (uint32_t i = 0; i < LORES_WIDTH * LORES_HEIGHT; ++i)
+    {
+        const rgba_t current = pixels[i];
+        const rgba_t target = (display[i / LORES_WIDTH] >> (63 - i % LORES_WIDTH)) & 1 ? s_palette.fg : s_palette.bg;
+        if (Framebuffer::IsSameColor(current, target)) continue;
+
+        float halfLife = -lerpDuration / log2f(precision);
+        float t = 1.0F - exp2f(-deltaTime / halfLife);
+        pixels[i] =
+        {
+            (uint8_t) (current.r + (target.r - current.r) * t),
+            (uint8_t) (current.g + (target.g - current.g) * t),
+            (uint8_t) (current.b + (target.b - current.b) * t),
+            (uint8_t) (current.a + (target.a - current.a) * t)
+        };
+    }
+}
+
+// Every row keeps fading: the display flips between two patterns each frame, as in a game
+// redrawing everything, so no pixel ever settles
+static int
+Fade(uint32_t frames)
+{
+    uint64_t patterns[2][LORES_HEIGHT];
+    std::mt19937_64 rng(0xC8);
+    for (auto &row : patterns[0]) row = rng();
+    for (uint32_t y = 0; y < LORES_HEIGHT; ++y) patterns[1][y] = ~patterns[0][y];
+
+    const float halfLife = -s_lerpDuration / log2f(s_precision);
+    const float t = 1.0F - exp2f(-s_frameTime / halfLife);
+
+    rgba_t pixels[LORES_WIDTH * LORES_HEIGHT];
+    auto reset = [&pixels]() { for (auto &pixel : pixels) pixel = s_palette.bg; };
+
+    auto rows = [&](auto &&fadeRow)
+    {
+        return [&, fadeRow](uint32_t frame)
+        {
+            bool isFading;
+            for (uint32_t y = 0; y < LORES_HEIGHT; ++y)
+            {
+                fadeRow(pixels + y * LORES_WIDTH, patterns[frame & 1][y], 0, s_palette, t, isFading);
+            }
+        };
+    };
+
+    // Read back at run time, as the front end's settings and frame time are
+    volatile float settings[3] = { s_precision, s_lerpDuration, s_frameTime };
+
+    reset();
+    double perPixel = Measure(frames, [&](uint32_t frame)
+    {
+        FadePerPixel(pixels, patterns[frame & 1], settings[0], settings[1], settings[2]);
+    });
+    reset();
+    double scalar = Measure(frames, rows(Framebuffer::FadeRowScalar));
+    reset();
+    double kernel = Measure(frames, rows(Framebuffer::FadeRow));
+
+    printf("Fading all %u pixels, %u frames\n", LORES_WIDTH * LORES_HEIGHT, frames);
+    printf("  %-28s %8.0f ns/frame\n", "factor per pixel", perPixel);
+    printf("  %-28s %8.0f ns/frame\n", "factor per frame, scalar", scalar);
+    printf("  %-28s %8.0f ns/frame  (%.1fx)\n", (std::string("factor per frame, ") + Framebuffer::GetKernelName()).c_str(),
+           kernel, perPixel / kernel);
+    return 0;
+}
+
+// Every filter over a display of sprites halfway through fading, at the window's scale unless told
+// otherwise, for the CHIP-8 display and the SUPER-CHIP one
+static int
+Scale(uint32_t frames, uint32_t scale)
+{
+    printf("Upscaling, %u frames\n", frames);
+
+    std::mt19937_64 rng(0xC8);
+    const uint32_t sizes[2][2] = { {LORES_WIDTH, LORES_HEIGHT}, {DISPLAY_WIDTH, DISPLAY_HEIGHT} };
+    for (const auto &size : sizes)
+    {
+        std::vector<rgba_t> pixels(size[0] * size[1]);
+        for (auto &pixel : pixels)
+        {
+            const uint32_t value = rng() % 8;
+            pixel = value < 5 ? s_palette.bg : value < 7 ? s_palette.fg : rgba_t{128, 128, 128, 255};
+        }
+
+        // The same window for both sizes
+        const uint32_t sizeScale = std::max(1u, scale * LORES_WIDTH / size[0]);
+        for (int i = 0; i < (int)Upscaler::filter_t::Count; ++i)
+        {
+            Upscaler upscaler;
+            upscaler.Configure((Upscaler::filter_t)i, size[0], size[1], sizeScale);
+
+            const double perFrame = Measure(frames, [&](uint32_t) { upscaler.Run(pixels.data()); });
+            const double megapixels = upscaler.GetWidth() * upscaler.GetHeight() / 1e6;
+            printf("  %3ux%-3u %-8s x%-2u -> %4ux%-4u %8.1f us/frame %8.2f ms/MP\n", size[0], size[1],
+                   Upscaler::GetFilterName((Upscaler::filter_t)i), upscaler.GetScale(), upscaler.GetWidth(),
+                   upscaler.GetHeight(), perFrame / 1e3, perFrame / 1e6 / megapixels);
+        }
+    }
+    return 0;
+}
+
+// A game redrawing its sprites all the time: 8 sprites of 15 rows across the display, XORed over
+// themselves a row lower on every pass
+static const uint8_t s_sprites[] =
+{
+    0x00, 0xE0,             // CLS
+    0xA2, 0x00,             // LD I, $200 (the program makes for sprites)
+    0x60, 0x00,             // LD V0, 0
+    0x61, 0x00,             // LD V1, 0
+    0x62, 0x08,             // LD V2, 8                    loop:
+    0xD0, 0x1F,             // DRW V0, V1, 15             sprite:
+    0x70, 0x08,             // ADD V0, 8
+    0x72, 0xFF,             // ADD V2, -1
+    0x32, 0x00,             // SE V2, 0
+    0x12, 0x0A,             // JP sprite
+    0x71, 0x01,             // ADD V1, 1
+    0x12, 0x08,             // JP loop
+};
+
+static int
+Deflick(uint32_t frames)
+{
+    Chip8 chip8;
+    chip8.WriteMemory(PROG_START, s_sprites, sizeof(s_sprites));
+
+    // Enough cycles for a pass or two: the display changes on most rows each frame
+    const uint32_t cycles = 50;
+    auto frame = std::make_unique<Chip8::frame_t>();
+    Deflicker deflicker;
+
+    // What the front end gets from the emulation every frame
+    auto run = [&](uint32_t) { chip8.Run(cycles); chip8.GetFrame(*frame); };
+    const double alone = Measure(frames, run);
+
+    printf("Running %u cycles a frame, %u frames\n", cycles, frames);
+    printf("  %-28s %8.0f ns/frame\n", "display alone", alone);
+    for (uint32_t mode = 1; mode < (uint32_t)Deflicker::mode_t::Count; ++mode)
+    {
+        for (uint32_t k = 2; k <= DEFLICKER_FRAMES; ++k)
+        {
+            deflicker.Configure((Deflicker::mode_t)mode, k);
+            const double blended = Measure(frames, [&](uint32_t i) { run(i); deflicker.Push(*frame); });
+
+            std::string name = std::string(Deflicker::GetModeName((Deflicker::mode_t)mode)) + ", " + std::to_string(k) + " frames";
+            printf("  %-28s %8.0f ns/frame  (+%.0f)\n", name.c_str(), blended, blended - alone);
+        }
+    }
+    return 0;
+}
+
+// The same sprites run 0-4 frames ahead: a snapshot, the frames ahead and a rollback for each shown
+static int
+RunAhead(uint32_t frames)
+{
+    printf("Running ahead, %u frames\n", frames);
+
+    const uint32_t speeds[] = { 10, 1000 };
+    for (uint32_t cycles : speeds)
+    {
+        for (uint32_t ahead = 0; ahead <= 4; ++ahead)
+        {
+            auto chip8 = std::make_unique<Chip8>();
+            auto snapshot = std::make_unique<Chip8::snapshot_t>();
+            chip8->WriteMemory(PROG_START, s_sprites, sizeof(s_sprites));
+            chip8->SetClockRate(cycles * 60);
+
+            uint64_t instructions = 0;
+            const double perFrame = Measure(frames, [&](uint32_t)
+            {
+                instructions += chip8->RunFor(1.0 / 60.0).cycles;
+                if (ahead == 0) return;
+
+                chip8->SaveSnapshot(*snapshot);
+                chip8->SetSpeculative(true);
+                for (uint32_t i = 0; i < ahead; ++i) instructions += chip8->RunFor(1.0 / 60.0).cycles;
+                chip8->SetSpeculative(false);
+                chip8->RestoreSnapshot(*snapshot);
+            });
+
+            printf("  %4u cycles/frame, %u ahead %8.0f ns/frame %8.0f instructions/frame\n", cycles, ahead, perFrame,
+                   (double)instructions / frames);
+        }
+    }
+    return 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        Usage();
+        return 2;
+    }
+
+    std::string command = argv[1];
+    if (command == "fade")
+    {
+        uint32_t frames = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100000;
+        return Fade(std::max(1u, frames));
+    }
+
+    if (command == "scale")
+    {
+        uint32_t frames = argc > 2 ? strtoul(argv[2], nullptr, 10) : 2000;
+        uint32_t scale = argc > 3 ? strtoul(argv[3], nullptr, 10) : 10;
+        return Scale(std::max(1u, frames), std::max(1u, scale));
+    }
+
+    if (command == "deflicker")
+    {
+        uint32_t frames = argc > 2 ? strtoul(argv[2], nullptr, 10) : 200000;
+        return Deflick(std::max(1u, frames));
+    }
+
+    if (command == "runahead")
+    {
+        uint32_t frames = argc > 2 ? strtoul(argv[2], nullptr, 10) : 200000;
+        return RunAhead(std::max(1u, frames));
+    }
+
+    Usage();
+    return 2;
+}
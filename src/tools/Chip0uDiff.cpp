@@ -0,0 +1,458 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Chip0uDiff: runs execution backends in lockstep with a reference over ROMs, with random inputs,
+// and stops at the first instruction where the machines differ
+
+#include "chip8/Chip8.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+typedef struct options_t
+{
+    Chip8::backend_t              reference {Chip8::backend_t::Interpreter};
+    std::vector<Chip8::backend_t> backends;
+
+    uint64_t cycles {1000000};      // Per ROM and backend
+    uint32_t stride {256};          // Instructions between comparisons, at most
+    bool     isFixedStride {false}; // Always `stride`, rather than random slices up to it
+    int      profile {-1};          // Chip8::profile_t, or from the extension
+    uint32_t seed {0xC8};
+    uint32_t clockRate {CLOCK_RATE};
+    uint32_t stops {0};             // Chip8::GetStopMask() bits every run stops on
+    uint32_t traceLength {24};
+} options_t;
+
+// A run of instructions both machines execute before being compared, and a key event during it
+typedef struct slice_t
+{
+    uint32_t length;
+    int8_t   key;                   // -1 for none
+    bool     isDown;
+    uint32_t keyDelay;              // Instructions into the slice the key goes in at
+} slice_t;
+
+static const char* s_backendNames[] = { "interpreter", "blocks", "jit", "threaded", "aot" };
+static const char* s_profileNames[] = { "chip0u", "chip8", "schip", "xochip" };
+
+
+static void
+Usage()
+{
+    printf("Usage: Chip0uDiff [options] [rom or directory...]   (default: roms)\n");
+    printf("  -a BACKEND    Reference backend (interpreter)\n");
+    printf("  -b BACKEND    Backend under test, repeatable (every available one but the reference)\n");
+    printf("  -n CYCLES     Instructions per ROM (1000000)\n");
+    printf("  -s N          Compare after random slices of up to N instructions (256)\n");
+    printf("  -S N          Compare after every N instructions; -S 1 compares every instruction\n");
+    printf("  -p PROFILE    Quirk profile (from the extension)\n");
+    printf("  -r SEED       Seed of the inputs, slices and RND (200)\n");
+    printf("  -c RATE       Guest clock, instructions per second: the timers tick every RATE/60 (%u)\n", CLOCK_RATE);
+    printf("  -e            Stop runs on draws, sounds and key waits, and compare where they stop\n");
+    printf("  -t LENGTH     Instructions shown before a divergence (24)\n");
+    printf("Backends: interpreter, blocks, jit, threaded. Profiles: chip0u, chip8, schip, xochip\n");
+}
+
+template <size_t N>
+static int
+FindName(const char* (&names)[N], const char* name)
+{
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (strcmp(names[i], name) == 0) return (int)i;
+    }
+    return -1;
+}
+
+static Chip8::profile_t
+GetProfile(const std::filesystem::path &rom, const options_t &options)
+{
+    if (options.profile >= 0) return (Chip8::profile_t)options.profile;
+
+    // Same guess as the front end
+    std::string extension = rom.extension().string();
+    if (extension == ".sc8") return Chip8::profile_t::SuperChip;
+    if (extension == ".xo8") return Chip8::profile_t::XoChip;
+    return Chip8::profile_t::Chip0u;
+}
+
+static void
+Setup(Chip8 &chip8, const std::filesystem::path &rom, Chip8::profile_t profile, Chip8::backend_t backend, const options_t &options)
+{
+    chip8.SetProfile(profile);
+    chip8.LoadGame(rom.string().c_str());
+    chip8.SetBackend(backend);
+    chip8.SetSeed(options.seed);
+    chip8.SetClockRate(options.clockRate);
+}
+
+static void
+Apply(Chip8 &chip8, const slice_t &slice)
+{
+    if (slice.key >= 0) chip8.QueueKey(chip8.GetCycles() + slice.keyDelay, slice.key, slice.isDown);
+}
+
+// Print what differs, keeping it short; returns whether anything does
+static bool
+Compare(const Chip8::chip8_t &a, const Chip8::chip8_t &b, bool isVerbose)
+{
+    bool isDifferent = false;
+    auto report = [&](const char* format, auto... args)
+    {
+        if (isVerbose) printf(format, args...);
+        isDifferent = true;
+    };
+
+    for (uint32_t i = 0; i < TOTAL_REGISTERS; ++i)
+    {
+        if (a.V[i] != b.V[i]) report("    V%X     %02X | %02X\n", i, a.V[i], b.V[i]);
+    }
+    if (a.I != b.I)   report("    I      %03X | %03X\n", a.I, b.I);
+    if (a.PC != b.PC) report("    PC     %03X | %03X\n", a.PC, b.PC);
+    if (a.SP != b.SP) report("    SP     %02X | %02X\n", a.SP, b.SP);
+    if (a.DT != b.DT) report("    DT     %02X | %02X\n", a.DT, b.DT);
+    if (a.ST != b.ST) report("    ST     %02X | %02X\n", a.ST, b.ST);
+    for (uint32_t i = 0; i < STACK_SIZE; ++i)
+    {
+        if (a.STACK[i] != b.STACK[i]) report("    STACK%X %03X | %03X\n", i, a.STACK[i], b.STACK[i]);
+    }
+
+    // Memory as ranges of differing bytes
+    for (uint32_t i = 0; i < TOTAL_RAM; ++i)
+    {
+        if (a.RAM[i] == b.RAM[i]) continue;
+
+        uint32_t end = i;
+        while (end < TOTAL_RAM && a.RAM[end] != b.RAM[end]) ++end;
+
+        report("    RAM    %03X-%03X, first %02X | %02X\n", i, end - 1, a.RAM[i], b.RAM[i]);
+        i = end;
+    }
+
+    for (uint32_t i = 0; i < RPL_SIZE; ++i)
+    {
+        if (a.RPL[i] != b.RPL[i]) report("    RPL%X   %02X | %02X\n", i, a.RPL[i], b.RPL[i]);
+    }
+    if (a.HIRES != b.HIRES) report("    HIRES  %u | %u\n", a.HIRES, b.HIRES);
+    if (a.PLANES != b.PLANES) report("    PLANES %u | %u\n", a.PLANES, b.PLANES);
+    if (a.PITCH != b.PITCH) report("    PITCH  %02X | %02X\n", a.PITCH, b.PITCH);
+    for (uint32_t i = 0; i < AUDIO_SIZE; ++i)
+    {
+        if (a.AUDIO[i] != b.AUDIO[i]) report("    AUDIO%X %02X | %02X\n", i, a.AUDIO[i], b.AUDIO[i]);
+    }
+
+    for (uint32_t p = 0; p < PLANE_COUNT; ++p)
+    {
+        uint32_t pixels = 0, first = 0;
+        for (uint32_t y = 0; y < DISPLAY_HEIGHT; ++y)
+        {
+            for (uint32_t w = 0; w < DISPLAY_WORDS; ++w)
+            {
+                uint64_t difference = a.DP[p][y][w] ^ b.DP[p][y][w];
+                if (difference == 0) continue;
+                if (pixels == 0) first = y * DISPLAY_WIDTH + w * 64 + std::countl_zero(difference);
+                pixels += std::popcount(difference);
+            }
+        }
+        if (pixels != 0) report("    DP%u    %u pixels, first at %u,%u\n", p, pixels, first % DISPLAY_WIDTH, first / DISPLAY_WIDTH);
+    }
+
+    return isDifferent;
+}
+
+// Run both machines through the first `count` slices
+static void
+Replay(Chip8 &a, Chip8 &b, const std::vector<slice_t> &slices, size_t count, const options_t &options)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        Apply(a, slices[i]);
+        Apply(b, slices[i]);
+        a.Run(slices[i].length, options.stops);
+        b.Run(slices[i].length, options.stops);
+    }
+}
+
+// Narrow a divergence down to the shortest run into the last slice that shows it, then print
+// the difference and what the reference executed on the way there
+static void
+Report(const std::filesystem::path &rom, Chip8::profile_t profile, Chip8::backend_t backend,
+       std::vector<slice_t> slices, const options_t &options)
+{
+    const slice_t last = slices.back();
+    slices.pop_back();
+
+    uint64_t start = 0;
+    for (const slice_t &slice : slices) start += slice.length;
+
+    // Fewer instructions into the slice run differently on block based backends, so this is
+    // the first point that diverges from the replay, rather than a guaranteed first bad instruction
+    auto diverges = [&](uint32_t length)
+    {
+        Chip8 a, b;
+        Setup(a, rom, profile, options.reference, options);
+        Setup(b, rom, profile, backend, options);
+        Replay(a, b, slices, slices.size(), options);
+        Apply(a, last);
+        Apply(b, last);
+        a.Run(length, options.stops);
+        b.Run(length, options.stops);
+        return Compare(a.GetState(), b.GetState(), false);
+    };
+
+    uint32_t low = 1, high = last.length;
+    while (low < high)
+    {
+        uint32_t middle = (low + high) / 2;
+        if (diverges(middle)) high = middle;
+        else low = middle + 1;
+    }
+
+    Chip8 a, b;
+    Setup(a, rom, profile, options.reference, options);
+    Setup(b, rom, profile, backend, options);
+    Replay(a, b, slices, slices.size(), options);
+    Apply(a, last);
+    Apply(b, last);
+
+    // Step the reference alone through the tail, one instruction at a time
+    uint64_t end = start + low;
+    uint64_t traceStart = end > options.traceLength ? end - options.traceLength : 0;
+    Chip8 tracer;
+    Setup(tracer, rom, profile, options.reference, options);
+
+    printf("%s: %s diverges from %s after instruction %llu (slice of %u at %llu)\n",
+           rom.filename().string().c_str(), Chip8::GetBackendName(backend), Chip8::GetBackendName(options.reference),
+           (unsigned long long)end, last.length, (unsigned long long)start);
+    printf("  trace (%s, registers before each instruction):\n", Chip8::GetBackendName(options.reference));
+
+    size_t slice = 0;
+    uint64_t cycle = 0, sliceEnd = 0;
+    while (cycle < end)
+    {
+        if (cycle == sliceEnd)
+        {
+            const slice_t &next = slice < slices.size() ? slices[slice] : last;
+            Apply(tracer, next);
+            sliceEnd += next.length;
+            ++slice;
+        }
+
+        if (cycle >= traceStart)
+        {
+            const Chip8::chip8_t &state = tracer.GetState();
+            uint16_t opcode = state.RAM[state.PC] << 8 | state.RAM[(state.PC + 1) % TOTAL_RAM];
+            const char* name = Chip8::Decode(opcode, profile).name;
+            printf("    %8llu  $%03X: %04X  %-5s I=%03X V0-F=", (unsigned long long)cycle, state.PC, opcode,
+                   name != nullptr ? name : "???", state.I);
+            for (uint32_t i = 0; i < TOTAL_REGISTERS; ++i) printf("%02X", state.V[i]);
+            printf("\n");
+        }
+
+        tracer.Run(1);
+        ++cycle;
+    }
+
+    a.Run(low, options.stops);
+    b.Run(low, options.stops);
+    printf("  difference (%s | %s):\n", Chip8::GetBackendName(options.reference), Chip8::GetBackendName(backend));
+    Compare(a.GetState(), b.GetState(), true);
+}
+
+// Returns false if the backend diverged from the reference
+static bool
+Check(const std::filesystem::path &rom, Chip8::backend_t backend, const options_t &options)
+{
+    Chip8::profile_t profile = GetProfile(rom, options);
+
+    Chip8 a, b;
+    Setup(a, rom, profile, options.reference, options);
+    Setup(b, rom, profile, backend, options);
+
+    // Slices and inputs only depend on the seed, so a divergence can be replayed
+    std::mt19937 rng(options.seed);
+    std::vector<slice_t> slices;
+    uint64_t done = 0;
+    while (done < options.cycles)
+    {
+        slice_t slice { options.isFixedStride ? options.stride : (uint32_t)(rng() % options.stride) + 1, -1, false, 0 };
+        if (rng() % 16 == 0)
+        {
+            slice.key = (int8_t)(rng() % KEYPAD_SIZE);
+            slice.isDown = rng() % 2 == 0;
+            slice.keyDelay = rng() % slice.length;
+        }
+        slices.push_back(slice);
+
+        Apply(a, slice);
+        Apply(b, slice);
+        const Chip8::run_t ranA = a.Run(slice.length, options.stops);
+        const Chip8::run_t ranB = b.Run(slice.length, options.stops);
+        done += ranA.cycles;
+
+        const bool isSameStop = ranA.reason == ranB.reason && ranA.cycles == ranB.cycles;
+        if (!isSameStop)
+        {
+            printf("%s: %s stopped (%u) after %u instructions of a slice, %s (%u) after %u\n",
+                   rom.filename().string().c_str(), Chip8::GetBackendName(options.reference), (uint32_t)ranA.reason,
+                   ranA.cycles, Chip8::GetBackendName(backend), (uint32_t)ranB.reason, ranB.cycles);
+        }
+
+        if (!isSameStop || Compare(a.GetState(), b.GetState(), false))
+        {
+            Report(rom, profile, backend, slices, options);
+            return false;
+        }
+
+        // Where the stop left it, so replays and traces line up
+        slices.back().length = ranA.cycles;
+    }
+
+    printf("%s: %s matches %s over %llu instructions (%s)\n", rom.filename().string().c_str(),
+           Chip8::GetBackendName(backend), Chip8::GetBackendName(options.reference),
+           (unsigned long long)done, Chip8::GetQuirks(profile).name);
+    return true;
+}
+
+static bool
+IsRom(const std::filesystem::path &path)
+{
+    std::string extension = path.extension().string();
+    return extension == ".ch8" || extension == ".sc8" || extension == ".xo8" || extension == ".rom";
+}
+
+int
+main(int argc, char* argv[])
+{
+    options_t options;
+    std::vector<std::filesystem::path> inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool hasValue = arg.size() == 2 && arg[0] == '-' && value != nullptr;
+
+        if (hasValue && (arg == "-a" || arg == "-b"))
+        {
+            int backend = FindName(s_backendNames, value);
+            if (backend < 0 || backend == (int)Chip8::backend_t::Aot)
+            {
+                printf("Unknown backend: %s\n", value);
+                return 2;
+            }
+            if (arg == "-a") options.reference = (Chip8::backend_t)backend;
+            else options.backends.push_back((Chip8::backend_t)backend);
+        }
+        else if (hasValue && arg == "-p")
+        {
+            options.profile = FindName(s_profileNames, value);
+            if (options.profile < 0)
+            {
+                printf("Unknown profile: %s\n", value);
+                return 2;
+            }
+        }
+        else if (hasValue && arg == "-n") options.cycles = strtoull(value, nullptr, 10);
+        else if (hasValue && arg == "-s") options.stride = std::max(1ul, strtoul(value, nullptr, 10));
+        else if (hasValue && arg == "-S")
+        {
+            options.stride = std::max(1ul, strtoul(value, nullptr, 10));
+            options.isFixedStride = true;
+        }
+        else if (hasValue && arg == "-r") options.seed = strtoul(value, nullptr, 10);
+        else if (hasValue && arg == "-c") options.clockRate = std::max(1ul, strtoul(value, nullptr, 10));
+        else if (hasValue && arg == "-t") options.traceLength = strtoul(value, nullptr, 10);
+        else if (arg == "-e")
+        {
+            options.stops = Chip8::GetStopMask(Chip8::stop_t::Draw) | Chip8::GetStopMask(Chip8::stop_t::Sound) |
+                            Chip8::GetStopMask(Chip8::stop_t::KeyWait);
+            continue;
+        }
+        else if (arg[0] == '-')
+        {
+            Usage();
+            return 2;
+        }
+        else
+        {
+            inputs.emplace_back(arg);
+            continue;
+        }
+
+        ++i;
+    }
+
+    // Every backend this host runs, against the reference
+    if (options.backends.empty())
+    {
+        Chip8 probe;
+        for (int i = 0; i < (int)Chip8::backend_t::Count; ++i)
+        {
+            auto backend = (Chip8::backend_t)i;
+            if (backend != options.reference && backend != Chip8::backend_t::Aot && probe.IsBackendAvailable(backend))
+            {
+                options.backends.push_back(backend);
+            }
+        }
+    }
+
+    if (inputs.empty()) inputs.emplace_back("roms");
+
+    std::vector<std::filesystem::path> roms;
+    for (const auto &input : inputs)
+    {
+        if (std::filesystem::is_directory(input))
+        {
+            for (const auto &entry : std::filesystem::directory_iterator(input))
+            {
+                if (entry.is_regular_file() && IsRom(entry.path())) roms.push_back(entry.path());
+            }
+        }
+        else if (std::filesystem::exists(input)) roms.push_back(input);
+        else printf("Not found: %s\n", input.string().c_str());
+    }
+    std::sort(roms.begin(), roms.end());
+
+    if (roms.empty())
+    {
+        Usage();
+        return 2;
+    }
+
+    uint32_t failures = 0;
+    for (const auto &rom : roms)
+    {
+        for (Chip8::backend_t backend : options.backends)
+        {
+            failures += !Check(rom, backend, options);
+        }
+    }
+
+    printf("%zu ROMs, %zu backends: %u divergences\n", roms.size(), options.backends.size(), failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// MIT License
+
+// Copyright (c) 2024 Leandro Peres, aka "zschzen"
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Chip0uTerm: runs a ROM on the terminal, for machines without a display
+
+#include "chip8/Chip8.h"
+#include "render/Terminal.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+static const char* s_backendNames[] = { "interpreter", "blocks", "jit", "threaded" };
+static const char* s_profileNames[] = { "chip0u", "chip8", "schip", "xochip" };
+
+
+static void
+Usage()
+{
+    printf("Usage: Chip0uTerm [options] rom\n");
+    printf("  -c CYCLES     Instructions per frame (10)\n");
+    printf("  -b BACKEND    interpreter, blocks, jit or threaded (blocks)\n");
+    printf("  -p PROFILE    chip0u, chip8, schip or xochip (from the extension)\n");
+    printf("  -f FRAMES     Quit after this many frames, and report the bytes written\n");
+    printf("Keys: 1234 QWER ASDF ZXCV, Esc to quit\n");
+}
+
+template <size_t N>
+static int
+FindName(const char* (&names)[N], const char* name)
+{
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (strcmp(names[i], name) == 0) return (int)i;
+    }
+    return -1;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t cycles = 10;
+    uint64_t frames = 0;
+    Chip8::backend_t backend = Chip8::backend_t::BlockCache;
+    int profile = -1;
+    std::string rom;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool hasValue = arg.size() == 2 && arg[0] == '-' && value != nullptr;
+
+        if (hasValue && arg == "-c") cycles = std::max(1ul, strtoul(value, nullptr, 10));
+        else if (hasValue && arg == "-f") frames = strtoull(value, nullptr, 10);
+        else if (hasValue && arg == "-b")
+        {
+            int index = FindName(s_backendNames, value);
+            if (index < 0)
+            {
+                printf("Unknown backend: %s\n", value);
+                return 2;
+            }
+            backend = (Chip8::backend_t)index;
+        }
+        else if (hasValue && arg == "-p")
+        {
+            profile = FindName(s_profileNames, value);
+            if (profile < 0)
+            {
+                printf("Unknown profile: %s\n", value);
+                return 2;
+            }
+        }
+        else if (arg[0] != '-' && rom.empty())
+        {
+            rom = arg;
+            continue;
+        }
+        else
+        {
+            Usage();
+            return 2;
+        }
+
+        ++i;
+    }
+
+    if (rom.empty())
+    {
+        Usage();
+        return 2;
+    }
+
+    // Same guess as the front end
+    std::string extension = rom.substr(std::min(rom.find_last_of('.'), rom.size()));
+    if (profile < 0) profile = (int)(extension == ".sc8" ? Chip8::profile_t::SuperChip :
+                                     extension == ".xo8" ? Chip8::profile_t::XoChip : Chip8::profile_t::Chip0u);
+
+    Chip8 chip8;
+    chip8.SetClockRate(cycles * 60);
+    chip8.SetProfile((Chip8::profile_t)profile);
+    chip8.LoadGame(rom.c_str());
+    if (chip8.IsBackendAvailable(backend)) chip8.SetBackend(backend);
+
+    // The core reports beeps on stdout; the screen gets its own descriptor and the bell instead
+    const int screen = dup(STDOUT_FILENO);
+    if (screen < 0 || freopen("/dev/null", "w", stdout) == nullptr) return 1;
+
+    Terminal terminal;
+    if (!terminal.Open(STDIN_FILENO, screen)) return 1;
+
+    // The window's loop: input, update, render, at 60 frames a second
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / 60.0));
+    auto next = std::chrono::steady_clock::now();
+    while (frames == 0 || terminal.GetFrameCount() < frames)
+    {
+        if (!terminal.Input(chip8)) break;
+        chip8.RunFor(1.0 / 60.0);
+        terminal.Present(chip8);
+
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+
+    terminal.Close();
+
+    if (frames != 0)
+    {
+        fprintf(stderr, "%llu frames, %llu bytes, %.1f bytes/frame\n", (unsigned long long)terminal.GetFrameCount(),
+                (unsigned long long)terminal.GetBytesWritten(),
+                (double)terminal.GetBytesWritten() / std::max<uint64_t>(1, terminal.GetFrameCount()));
+    }
+    return 0;
+}